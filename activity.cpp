@@ -0,0 +1,69 @@
+#include "activity.h"
+#include "post.h"
+#include <chrono>
+
+lightforums::activityPropagator::activityPropagator() :
+	running_(false)
+{
+}
+
+lightforums::activityPropagator::~activityPropagator() {
+	stop();
+}
+
+void lightforums::activityPropagator::touched(std::shared_ptr<post> at, time_t when) {
+	if (!running_) {
+		propagate(at.get(), when);
+		return;
+	}
+	std::lock_guard<std::mutex> guard(lock_);
+	pendingActivity& noted = pending_[at.get()];
+	if (!noted.at) {
+		noted.at = at;
+		noted.when = when;
+	} else if (noted.when < when) noted.when = when;
+}
+
+void lightforums::activityPropagator::start() {
+	if (running_.exchange(true)) return;
+	propagator_ = std::thread([this] () { propagateLoop(); });
+}
+
+void lightforums::activityPropagator::stop() {
+	if (!running_.exchange(false)) return;
+	{
+		std::lock_guard<std::mutex> guard(wakeLock_);
+		wake_.notify_one();
+	}
+	propagator_.join();
+	propagateAll(); // Whatever came while it was leaving
+}
+
+void lightforums::activityPropagator::propagate(post* from, time_t when) {
+	post* at = from;
+	while (at->lastActivity_ < when) {
+		at->setActivity(when);
+		std::shared_ptr<post> parent = at->getParent();
+		if (!parent || parent.get() == at) break; // Root or detached
+		at = parent.get();
+	}
+}
+
+void lightforums::activityPropagator::propagateAll() {
+	std::unordered_map<post*, pendingActivity> taken;
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		taken.swap(pending_);
+	}
+	for (auto it = taken.begin(); it != taken.end(); it++) propagate(it->first, it->second.when);
+}
+
+void lightforums::activityPropagator::propagateLoop() {
+	while (running_) {
+		{
+			std::unique_lock<std::mutex> lock(wakeLock_);
+			if (running_) wake_.wait_for(lock, std::chrono::milliseconds(ACTIVITY_DELAY));
+		}
+		propagateAll();
+	}
+}
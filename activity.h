@@ -0,0 +1,60 @@
+#ifndef ACTIVITY_H
+#define ACTIVITY_H
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <ctime>
+
+#define ACTIVITY_DELAY 250 // Milliseconds for which the activity of ancestors may be out of date
+
+namespace lightforums {
+
+	class post;
+
+	class activityPropagator {
+		// Carries the time of the last activity from new posts up to their ancestors. Posting only notes the parent
+		// and a background thread walks up from all parents noted during the last moment at once. The walk stops
+		// at the first ancestor that is already as new, so a busy thread updates its ancestors up to the root
+		// once per batch instead of once per post, and only this thread writes to them.
+		// Until it's started, activity is carried up immediately, which is what loading and replaying need.
+	public:
+		static inline activityPropagator& get() {
+			static activityPropagator holder;
+			return holder;
+		}
+
+		void touched(std::shared_ptr<post> at, time_t when); // Something was posted into it
+		void start();
+		void stop(); // Carries up everything noted before stopping
+
+	private:
+		activityPropagator();
+		~activityPropagator();
+
+		void propagate(post* from, time_t when);
+		void propagateLoop();
+		void propagateAll();
+
+		struct pendingActivity {
+			std::shared_ptr<post> at;
+			time_t when;
+		};
+
+		std::mutex lock_;
+		std::unordered_map<post*, pendingActivity> pending_;
+		std::thread propagator_;
+		std::atomic_bool running_;
+		std::mutex wakeLock_;
+		std::condition_variable wake_;
+
+		activityPropagator(const activityPropagator&) = delete;
+		void operator=(const activityPropagator&) = delete;
+	};
+
+}
+
+#endif // ACTIVITY_H
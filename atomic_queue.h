@@ -11,144 +11,96 @@
 
 template<typename V>
 class atomic_queue {
-	// A queue that can be simultaneously accessed from many threads...
-	template <typename T>
-	struct selfdestructing_array {
-		T* contents_;
-		unsigned long int size_;
-		selfdestructing_array(unsigned long int size) :
-			contents_(new T[size]),
-			size_(size) {}
-		~selfdestructing_array() { delete[] contents_; }
+	// A bounded queue that can be simultaneously pushed to and popped from by many threads. Every cell
+	// carries a sequence number telling if it's free to be written in this lap around the array or ready
+	// to be read, so neither side needs a lock. Pushing into a full queue waits until something is popped.
+	// Entries are popped in the order of the tickets push() returned.
+	struct cell {
+		std::atomic_uint_fast64_t sequence_;
+		V data_;
 	};
 
-	typedef std::shared_ptr<selfdestructing_array<V>> holder_type;
-	holder_type data_;
-	std::atomic_uint_fast64_t start_; // Here's where entries whose reading was finished start
-	std::atomic_uint_fast64_t unread_; // Here's where unread entries start
-	std::atomic_uint_fast64_t written_; // Here's where entries that are being written start
-	std::atomic_uint_fast64_t end_; // Here's where the next entry will be written
-
-	std::atomic_uint accessed_; // Twice the number of accessors, odd numbers mean that it's time to rehash
-
-	struct read_lock {
-		atomic_queue& parent_;
-		read_lock(atomic_queue* parent):
-		parent_(*parent) {
-			uint was, want;
-			do {
-				was = parent_.accessed_;
-				while (was % 2) {
-					std::this_thread::sleep_for(std::chrono::microseconds(1));
-					was = parent_.accessed_;
-				}
-				want = was + 2;
-			} while (!std::atomic_compare_exchange_weak_explicit(&parent_.accessed_, &was, want,
-						std::memory_order_release, std::memory_order_relaxed));
-		}
-		~read_lock() {
-			uint was, want;
-			do {
-				was = parent_.accessed_;
-				want = was - 2;
-			} while (!std::atomic_compare_exchange_weak_explicit(&parent_.accessed_, &was, want,
-						std::memory_order_release, std::memory_order_relaxed));
-		}
-	};
-	void resize(unsigned long int new_size) {
-		// This one will be executed only a few times, the lock is thus not performance-degradating
-		// Will only enlarge the array, never shrink it
-		uint was, want;
-		do {
-			was = accessed_;
-			if (was % 2) {
-				// Being done elsewhere, wait till done
-				do {
-					std::this_thread::sleep_for(std::chrono::microseconds(1));
-					was = accessed_;
-				} while (was % 2);
-				return;
-			}
-			want = was + 1;
-		} while (!std::atomic_compare_exchange_weak_explicit(&accessed_, &was, want,
-											std::memory_order_release, std::memory_order_relaxed));
-		if (std::atomic_load(&data_)->size_ >= new_size) {
-			accessed_--;
-			return; // Already enlarged
-		}
-		// Others clearing our way
-		while (accessed_ != 3) // It's locked by this thread already, so 3 = 2 + 1
-			std::this_thread::sleep_for(std::chrono::microseconds(1));
+	std::unique_ptr<cell[]> cells_;
+	unsigned long int mask_;
+	char padding1_[64]; // Keep the counters on different cache lines, both are hammered by different threads
+	std::atomic_uint_fast64_t enqueued_; // Next position to be written
+	char padding2_[64];
+	std::atomic_uint_fast64_t dequeued_; // Next position to be read
+	char padding3_[64];
 
-		// Way's clear, resize
-		unsigned long int start = start_;
-		unsigned long int length = size();
-		unsigned long int end;
-		unsigned long int old_size = data_->size_;
-		holder_type data(new selfdestructing_array<V>(new_size));
-		for (end = 0; end < length; end++) {
-			data->contents_[end] = data_->contents_[(start + end + old_size) % old_size];
+	template <typename T>
+	bool push_impl(T&& val, uint_fast64_t* ticket) {
+		uint_fast64_t pos = enqueued_.load(std::memory_order_relaxed);
+		cell* target;
+		while (true) {
+			target = &cells_[pos & mask_];
+			uint_fast64_t sequence = target->sequence_.load(std::memory_order_acquire);
+			if (sequence == pos) {
+				if (enqueued_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (sequence < pos) {
+				return false; // Full, the reader of the previous lap is not done yet
+			} else pos = enqueued_.load(std::memory_order_relaxed);
 		}
-		start_ = 0;
-		unread_ = 0;
-		written_ = end;
-		end_ = end;
-		data_ = data;
-		accessed_ = 2;
+		target->data_ = std::forward<T>(val);
+		target->sequence_.store(pos + 1, std::memory_order_release);
+		if (ticket) *ticket = pos;
+		return true;
 	}
 
-
 public:
-	atomic_queue(unsigned long int size = 10) :
-		data_(new selfdestructing_array<V>(size)),
-		start_(0),
-		unread_(0),
-		written_(0),
-		end_(0),
-		accessed_(0)
-	{ }
+	atomic_queue(unsigned long int size = 1024) :
+		enqueued_(0),
+		dequeued_(0)
+	{
+		unsigned long int rounded = 2;
+		while (rounded < size) rounded <<= 1; // Must be a power of two
+		cells_.reset(new cell[rounded]);
+		mask_ = rounded - 1;
+		for (unsigned long int i = 0; i < rounded; i++)
+			cells_[i].sequence_.store(i, std::memory_order_relaxed);
+	}
 
-	unsigned long int size() {
-		unsigned long int start = unread_;
-		unsigned long int end = written_;
-		if (start <= end) return end - start;
-		else return std::atomic_load(&data_)->size_ - (start - end);
+	bool try_push(const V& val, uint_fast64_t* ticket = nullptr) { return push_impl(val, ticket); }
+	bool try_push(V&& val, uint_fast64_t* ticket = nullptr) { return push_impl(std::move(val), ticket); }
+
+	uint_fast64_t push(V val) {
+		uint_fast64_t ticket;
+		while (!push_impl(std::move(val), &ticket))
+			std::this_thread::sleep_for(std::chrono::microseconds(1));
+		return ticket;
 	}
 
-	void push(const V& val) {
-		read_lock lock(this);
-		unsigned long int pos, updated;
-		unsigned long int data_size = data_->size_;
-		do {
-			pos = end_;
-			updated = (pos + 1) % data_size;
-		} while (!std::atomic_compare_exchange_weak_explicit(&end_, &pos, updated,
-										std::memory_order_release, std::memory_order_relaxed));
-		if (pos == ((start_ + data_size) - 2) % data_size) resize(std::atomic_load(&data_)->size_ * 2);
-		std::atomic_load(&data_)->contents_[pos] = val;
-		std::cerr << "Writing at " << pos << ": " << val << std::endl;
-		// Move the iterator showing already written parts only if those before were already written
-		while (!std::atomic_compare_exchange_weak_explicit(&written_, &pos, updated,
-										std::memory_order_release, std::memory_order_relaxed)) {};
+	bool try_pop(V& into) {
+		uint_fast64_t pos = dequeued_.load(std::memory_order_relaxed);
+		cell* source;
+		while (true) {
+			source = &cells_[pos & mask_];
+			uint_fast64_t sequence = source->sequence_.load(std::memory_order_acquire);
+			if (sequence == pos + 1) {
+				if (dequeued_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			} else if (sequence < pos + 1) {
+				return false; // Empty
+			} else pos = dequeued_.load(std::memory_order_relaxed);
+		}
+		into = std::move(source->data_);
+		source->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
 	}
 
 	V pop() {
-		read_lock lock(this);
-		unsigned long int pos, updated;
-		do {
-			pos = unread_;
-			updated = (pos + 1) % data_->size_;
-		} while (!std::atomic_compare_exchange_weak_explicit(&unread_, &pos, updated,
-										std::memory_order_release, std::memory_order_relaxed));
-		V result = std::atomic_load(&data_)->contents_[pos];
-		std::cerr << "Reading from " << pos << ": " << result << std::endl;
-		// Move the iterator showing already read parts only if those before were already read
-		while (!std::atomic_compare_exchange_weak_explicit(&start_, &pos, updated,
-										std::memory_order_release, std::memory_order_relaxed)) {};
+		V result;
+		while (!try_pop(result))
+			std::this_thread::sleep_for(std::chrono::microseconds(1));
 		return result;
 	}
 
+	unsigned long int size() {
+		uint_fast64_t start = dequeued_.load(std::memory_order_relaxed);
+		uint_fast64_t end = enqueued_.load(std::memory_order_relaxed);
+		return (end > start) ? end - start : 0;
+	}
+
+	unsigned long int capacity() { return mask_ + 1; }
 };
 
 #endif // ATOMIC_QUEUE
-
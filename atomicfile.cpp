@@ -0,0 +1,176 @@
+#include "atomicfile.h"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define FOOTER_START "<!-- checksum "
+#define FOOTER_END " -->\n"
+#define FOOTER_SIZE (sizeof(FOOTER_START) - 1 + 16 + sizeof(FOOTER_END) - 1)
+
+namespace {
+
+	const uint64_t checksumStart = 0xcbf29ce484222325ull;
+	const uint64_t checksumPrime = 0x100000001b3ull;
+
+	inline uint64_t readWord(const unsigned char* data) {
+		// Byte by byte, so that the checksum doesn't depend on endianness
+		uint64_t result = 0;
+		for (int i = 7; i >= 0; i--) result = (result << 8) | data[i];
+		return result;
+	}
+
+	bool syncFile(int file) {
+#ifdef _WIN32
+		return !_commit(file);
+#else
+		return !fsync(file);
+#endif
+	}
+
+	void syncDirectoryOf(const std::string& fileName) {
+#ifndef _WIN32
+		// The rename is durable only after the directory is synced
+		size_t slash = fileName.find_last_of('/');
+		std::string directory = (slash == std::string::npos) ? "." : fileName.substr(0, slash + 1);
+		int file = ::open(directory.c_str(), O_RDONLY);
+		if (file < 0) return;
+		fsync(file);
+		::close(file);
+#endif
+	}
+
+}
+
+lightforums::atomicFile::atomicFile() :
+	file_(-1),
+	failed_(false),
+	checksum_(checksumStart),
+	length_(0),
+	pending_(0),
+	pendingSize_(0)
+{
+}
+
+lightforums::atomicFile::~atomicFile() {
+	discard();
+}
+
+bool lightforums::atomicFile::open(const std::string& fileName) {
+	discard();
+	fileName_ = fileName;
+	temporary_ = fileName + ".tmp";
+	checksum_ = checksumStart;
+	length_ = 0;
+	pending_ = 0;
+	pendingSize_ = 0;
+	file_ = ::open(temporary_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	failed_ = (file_ < 0);
+	return !failed_;
+}
+
+bool lightforums::atomicFile::write(const char* data, size_t size) {
+	if (file_ < 0 || failed_) return false;
+	addToChecksum(data, size);
+	while (size > 0) {
+		ssize_t written = ::write(file_, data, size);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			failed_ = true;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool lightforums::atomicFile::commit(bool syncDirectory) {
+	if (file_ < 0) return false;
+	char footer[FOOTER_SIZE + 1];
+	snprintf(footer, sizeof(footer), FOOTER_START "%016llx" FOOTER_END, (unsigned long long)finishChecksum());
+	write(footer, FOOTER_SIZE);
+	if (!failed_ && !syncFile(file_)) failed_ = true;
+	if (::close(file_)) failed_ = true;
+	file_ = -1;
+	if (failed_) {
+		remove(temporary_.c_str());
+		return false;
+	}
+
+	// The current file becomes .old without ever being missing, the new one replaces it in one step
+	std::string old = fileName_ + ".old";
+	std::string veryOld = fileName_ + ".very_old";
+	rename(old.c_str(), veryOld.c_str());
+#ifdef _WIN32
+	rename(fileName_.c_str(), old.c_str());
+#else
+	if (link(fileName_.c_str(), old.c_str()) && errno != ENOENT) rename(fileName_.c_str(), old.c_str());
+#endif
+	if (rename(temporary_.c_str(), fileName_.c_str())) {
+		remove(temporary_.c_str());
+		return false;
+	}
+	if (syncDirectory) syncDirectoryOf(fileName_);
+	return true;
+}
+
+void lightforums::atomicFile::discard() {
+	if (file_ < 0) return;
+	::close(file_);
+	file_ = -1;
+	remove(temporary_.c_str());
+}
+
+void lightforums::atomicFile::addToChecksum(const char* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	length_ += size;
+	while (pendingSize_ > 0 && pendingSize_ < 8 && size > 0) {
+		pending_ |= (uint64_t)*bytes << (pendingSize_ << 3);
+		pendingSize_++;
+		bytes++;
+		size--;
+	}
+	if (pendingSize_ == 8) {
+		checksum_ = (checksum_ ^ pending_) * checksumPrime;
+		pending_ = 0;
+		pendingSize_ = 0;
+	}
+	for ( ; size >= 8; bytes += 8, size -= 8) checksum_ = (checksum_ ^ readWord(bytes)) * checksumPrime;
+	for ( ; size > 0; bytes++, size--) {
+		pending_ |= (uint64_t)*bytes << (pendingSize_ << 3);
+		pendingSize_++;
+	}
+}
+
+uint64_t lightforums::atomicFile::finishChecksum() {
+	uint64_t result = (checksum_ ^ pending_) * checksumPrime;
+	result = (result ^ length_) * checksumPrime;
+	// Spread the last bits over the whole number
+	result ^= result >> 33;
+	result *= 0xff51afd7ed558ccdull;
+	result ^= result >> 33;
+	return result;
+}
+
+lightforums::atomicFile::checksumState lightforums::atomicFile::verify(const char* data, size_t size) {
+	if (size < FOOTER_SIZE) return CHECKSUM_MISSING;
+	const char* footer = data + size - FOOTER_SIZE;
+	if (memcmp(footer, FOOTER_START, sizeof(FOOTER_START) - 1) || memcmp(footer + FOOTER_SIZE - sizeof(FOOTER_END) + 1, FOOTER_END, sizeof(FOOTER_END) - 1))
+		return CHECKSUM_MISSING;
+	uint64_t saved = 0;
+	for (const char* digit = footer + sizeof(FOOTER_START) - 1; digit < footer + sizeof(FOOTER_START) - 1 + 16; digit++) {
+		if (*digit >= '0' && *digit <= '9') saved = (saved << 4) | (*digit - '0');
+		else if (*digit >= 'a' && *digit <= 'f') saved = (saved << 4) | (*digit - 'a' + 10);
+		else return CHECKSUM_MISSING;
+	}
+	atomicFile counter;
+	counter.addToChecksum(data, size - FOOTER_SIZE);
+	return (counter.finishChecksum() == saved) ? CHECKSUM_FINE : CHECKSUM_WRONG;
+}
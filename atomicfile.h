@@ -0,0 +1,49 @@
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include <string>
+#include <cstdint>
+
+namespace lightforums {
+
+	class atomicFile {
+		// Writes a file under a temporary name and puts it in place of the old one only after it's complete and synced,
+		// so a crash leaves either the old file or the new one, never a part of it. The previous file is kept as .old
+		// and the one before as .very_old. A footer with a checksum of the contents is appended, it's an XML comment
+		// so that XML files stay valid and it's after the end of binary files where nothing reads it.
+	public:
+		atomicFile();
+		~atomicFile(); // Throws the file away if it wasn't committed
+
+		bool open(const std::string& fileName);
+		bool write(const char* data, size_t size);
+		bool commit(bool syncDirectory = true); // Without syncing the directory, the file is in place only after some later commit does it
+		void discard();
+
+		enum checksumState {
+			CHECKSUM_FINE,
+			CHECKSUM_MISSING, // Written before checksums were added, or cut off
+			CHECKSUM_WRONG
+		};
+		static checksumState verify(const char* data, size_t size);
+
+	private:
+		void addToChecksum(const char* data, size_t size);
+		uint64_t finishChecksum();
+
+		std::string fileName_;
+		std::string temporary_;
+		int file_;
+		bool failed_;
+		uint64_t checksum_;
+		uint64_t length_;
+		uint64_t pending_; // Bytes that don't make a whole word yet
+		unsigned int pendingSize_;
+
+		atomicFile(const atomicFile&) = delete;
+		void operator=(const atomicFile&) = delete;
+	};
+
+}
+
+#endif // ATOMICFILE_H
@@ -0,0 +1,109 @@
+#include "forum.h"
+#include <iostream>
+#include <cstring>
+#include "userlist.h"
+#include "user.h"
+#include "postindex.h"
+
+// Measures how long counting the ratings and posts of every user takes on startup.
+// Usage: digestbench [users] [posts] [ratings per user], 50000 users, a million posts and 5 by default.
+// With -walk first, it also counts them the way it was done before, walking the tree once per user,
+// which takes users times posts steps, so try that with a few hundred users only.
+
+namespace {
+
+	struct counts {
+		uint64_t posts = 0;
+		uint64_t ratings = 0;
+	};
+
+	counts total() {
+		counts result;
+		std::vector<std::shared_ptr<lightforums::post>> left(1, root::get().getRootPost());
+		while (!left.empty()) {
+			std::shared_ptr<lightforums::post> at = left.back();
+			left.pop_back();
+			for (unsigned int i = 0; i < lightforums::ratingSize; i++) result.ratings += at->rating_[i];
+			for (auto it = at->children_.begin(); it != at->children_.end(); it++) left.push_back(it->second);
+		}
+		for (unsigned int i = 0; ; i++) {
+			std::shared_ptr<lightforums::user> counted = lightforums::userList::get().getUser("user" + std::to_string(i));
+			if (!counted) break;
+			result.posts += counted->posts_;
+		}
+		return result;
+	}
+
+	void walkFor(std::shared_ptr<lightforums::user> digesting, const std::string& name, std::shared_ptr<lightforums::post> from) {
+		// The old way, the ratings this user gave and the posts they wrote, looked for in the whole tree
+		auto found = digesting->ratings_.find(from->getUid());
+		if (found != digesting->ratings_.end()) {
+			from->rating_[found->second]++;
+			std::shared_ptr<lightforums::user> author = lightforums::userList::get().getUser(*from->author_);
+			if (author) author->rating_[found->second]++;
+		}
+		if (*from->author_ == name) digesting->posts_++;
+		for (auto it = from->children_.begin(); it != from->children_.end(); it++) walkFor(digesting, name, it->second);
+	}
+
+	void clear() {
+		std::vector<std::shared_ptr<lightforums::post>> left(1, root::get().getRootPost());
+		while (!left.empty()) {
+			std::shared_ptr<lightforums::post> at = left.back();
+			left.pop_back();
+			for (unsigned int i = 0; i < lightforums::ratingSize; i++) at->rating_[i] = 0;
+			for (auto it = at->children_.begin(); it != at->children_.end(); it++) left.push_back(it->second);
+		}
+		for (unsigned int i = 0; ; i++) {
+			std::shared_ptr<lightforums::user> cleared = lightforums::userList::get().getUser("user" + std::to_string(i));
+			if (!cleared) break;
+			cleared->posts_ = 0;
+			for (unsigned int j = 0; j < lightforums::ratingSize; j++) cleared->rating_[j] = 0;
+		}
+	}
+
+}
+
+int main(int argc, char** argv) {
+	bool walk = (argc > 1 && !strcmp(argv[1], "-walk"));
+	if (walk) {
+		argc--;
+		argv++;
+	}
+	unsigned int users = argc > 1 ? atoi(argv[1]) : 50000;
+	unsigned int posts = argc > 2 ? atoi(argv[2]) : 1000000;
+	unsigned int ratings = argc > 3 ? atoi(argv[3]) : 5;
+
+	auto start = std::chrono::steady_clock::now();
+	std::string save = bench::makeSave(users, posts, ratings, 100);
+	std::cout << "Made a save of " << users << " users and " << posts << " posts, " << save.size() / (1 << 20) << " MB, in "
+			<< bench::secondsSince(start) << " s" << std::endl;
+	start = std::chrono::steady_clock::now();
+	bench::load(save);
+	std::string().swap(save);
+	std::cout << "Loaded in " << bench::secondsSince(start) << " s" << std::endl;
+
+	// What setupStructures does after loading, there's no journal to replay here
+	start = std::chrono::steady_clock::now();
+	lightforums::postIndex::get().assignMissing(root::get().getRootPost());
+	lightforums::userList::get().resolveRatings(root::get().getRootPost());
+	lightforums::userList::get().digestPost(root::get().getRootPost());
+	double took = bench::secondsSince(start);
+	counts digested = total();
+	std::cout << "Digested in " << took << " s: " << digested.posts << " posts and " << digested.ratings << " ratings counted" << std::endl;
+
+	if (walk) {
+		clear();
+		start = std::chrono::steady_clock::now();
+		std::shared_ptr<lightforums::post> rootPost = root::get().getRootPost();
+		for (unsigned int i = 0; i < users; i++) {
+			std::string name = "user" + std::to_string(i);
+			walkFor(lightforums::userList::get().getUser(name), name, rootPost);
+		}
+		took = bench::secondsSince(start);
+		counts walked = total();
+		std::cout << "Walking once per user took " << took << " s: " << walked.posts << " posts and " << walked.ratings << " ratings counted" << std::endl;
+	}
+	std::cout << "At most " << bench::memoryKb("VmHWM") / 1024 << " MB were used" << std::endl;
+	return 0;
+}
@@ -0,0 +1,110 @@
+#ifndef BENCH_FORUM_H
+#define BENCH_FORUM_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <cstdlib>
+#include "rapidxml.hpp"
+#include "post.h"
+#include "userlist.h"
+#include "settings.h"
+#include "mainwindow.h"
+
+// Made-up forums for the benchmarks, saved as XML and loaded the way the server does on startup
+
+namespace bench {
+
+	inline std::string makeText(size_t size) {
+		std::string text;
+		while (text.size() < size) text += "Some *text* with _markup_, {a spoiler} and [a link|/1/]. ";
+		text.resize(size);
+		return text;
+	}
+
+	inline std::string makeSave(unsigned int users, unsigned int posts, unsigned int ratingsPerUser, size_t textSize) {
+		// Threads of a hundred posts, every reply is under a random earlier post of its thread, so depths vary.
+		// The root has the global id 1, the posts follow in the order they are written.
+		std::mt19937 random(1);
+		std::string text = makeText(textSize);
+		std::string result = "<forums><users>";
+		for (unsigned int i = 0; i < users; i++) {
+			result += "<user name=\"user" + std::to_string(i) + "\" rank=\"1\"><description>Someone</description><rated>";
+			for (unsigned int j = 0; j < ratingsPerUser && posts; j++) {
+				std::string rate = std::to_string(random() % lightforums::ratingSize);
+				result += "<" + rate + ">" + std::to_string(random() % posts + 2) + "</" + rate + ">";
+			}
+			result += "</rated></user>";
+		}
+		result += "</users><posts><post title=\"Forum\" author=\"user0\" id=\"0\" uid=\"1\" depth=\"3\" posted_at=\"1500000000\">";
+		result += "<text>Welcome</text>";
+		uint64_t uid = 2;
+		const unsigned int threadSize = 100;
+		unsigned int threads = (posts + threadSize - 1) / threadSize;
+		std::vector<std::vector<unsigned int>> children;
+		std::vector<unsigned int> stack;
+		for (unsigned int thread = 0; thread < threads; thread++) {
+			unsigned int size = std::min(threadSize, posts - thread * threadSize);
+			children.assign(size, std::vector<unsigned int>());
+			for (unsigned int i = 1; i < size; i++) children[random() % i].push_back(i);
+			// Written depth first, an element is closed once all its children are
+			std::vector<std::pair<unsigned int, unsigned int>> open; // Post in the thread, next child to write
+			auto start = [&] (unsigned int index, unsigned int id) {
+				result += "<post title=\"" + std::string(index ? "Re: Thread " : "Thread ") + std::to_string(thread)
+						+ "\" author=\"user" + std::to_string(users ? random() % users : 0) + "\" id=\"" + std::to_string(id)
+						+ "\" uid=\"" + std::to_string(uid++) + "\" depth=\"3\" posted_at=\"" + std::to_string(1500000000 + uid)
+						+ "\" next_child=\"" + std::to_string(children[index].size()) + "\"><text>" + text + "</text>";
+				open.push_back(std::make_pair(index, 0));
+			};
+			start(0, thread);
+			while (!open.empty()) {
+				std::pair<unsigned int, unsigned int>& top = open.back();
+				if (top.second == children[top.first].size()) {
+					result += "</post>";
+					open.pop_back();
+				} else {
+					unsigned int id = top.second++;
+					start(children[top.first][id], id);
+				}
+			}
+		}
+		result += "</post></posts></forums>";
+		return result;
+	}
+
+	inline void load(std::string& save) {
+		// Like loadStructures in main.cpp, without the checksum and in a single thread
+		rapidxml::xml_document<> document;
+		document.parse<0>(&save[0]);
+		rapidxml::xml_node<>* forums = document.first_node();
+		lightforums::Settings::get().setup(forums->first_node("settings"));
+		lightforums::userList::get().setupUserList(forums->first_node("users"));
+		rapidxml::xml_node<>* posts = forums->first_node("posts");
+		lightforums::post* made = new lightforums::post(nullptr, posts->first_node("post"));
+		made->updateActivity();
+		root::get().setRootPost(made->self());
+	}
+
+	inline double secondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	inline long int memoryKb(const std::string& field) {
+		// VmRSS is the memory used now, VmHWM the most used since the start or since resetPeakMemory()
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line)) {
+			if (line.compare(0, field.size() + 1, field + ":") == 0) return atol(line.c_str() + field.size() + 1);
+		}
+		return -1;
+	}
+
+	inline void resetPeakMemory() {
+		std::ofstream("/proc/self/clear_refs") << "5";
+	}
+
+}
+
+#endif // BENCH_FORUM_H
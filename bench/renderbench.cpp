@@ -0,0 +1,65 @@
+#include "forum.h"
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <Wt/WApplication>
+#include <Wt/Test/WTestEnvironment>
+#include "translation.h"
+
+// Measures looking up the strings shown and building the widgets of a thread with five replies,
+// in time and in heap allocations, which include those Wt makes for the widgets.
+// Usage: renderbench
+
+namespace {
+
+	size_t allocations = 0;
+
+}
+
+void* operator new(size_t size) {
+	allocations++;
+	void* made = malloc(size ? size : 1);
+	if (!made) throw std::bad_alloc();
+	return made;
+}
+
+void operator delete(void* freed) noexcept {
+	free(freed);
+}
+
+void operator delete(void* freed, size_t) noexcept {
+	free(freed);
+}
+
+int main() {
+	Wt::Test::WTestEnvironment environment;
+	Wt::WApplication application(environment);
+
+	size_t total = 0;
+	const unsigned int rounds = 200000;
+	auto start = std::chrono::steady_clock::now();
+	size_t before = allocations;
+	for (unsigned int round = 0; round < rounds; round++) {
+		for (unsigned int i = 0; i < lightforums::tr::translatableMax; i++) total += lightforums::tr::get((lightforums::tr::translatable)i).size();
+	}
+	double took = bench::secondsSince(start);
+	std::cout << "tr::get: " << took * 1e9 / rounds / lightforums::tr::translatableMax << " ns and "
+			<< double(allocations - before) / rounds / lightforums::tr::translatableMax << " allocations per lookup" << std::endl;
+
+	std::string save = bench::makeSave(10, 6, 0, 200);
+	bench::load(save);
+	std::shared_ptr<lightforums::post> thread = root::get().getRootPost()->children_.begin()->second;
+	for (unsigned int round = 0; round < 3; round++) {
+		unsigned int builds = 0;
+		start = std::chrono::steady_clock::now();
+		do {
+			delete thread->build("", 2);
+			builds++;
+			took = bench::secondsSince(start);
+		} while (took < 1);
+		before = allocations;
+		delete thread->build("", 2);
+		std::cout << "post::build: " << took * 1e6 / builds << " us and " << allocations - before << " allocations per thread" << std::endl;
+	}
+	return total ? 0 : 1;
+}
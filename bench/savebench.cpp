@@ -0,0 +1,130 @@
+#include "forum.h"
+#include <iostream>
+#include <cstdio>
+#include <functional>
+#include <sys/stat.h>
+#include "rapidxml_print.hpp"
+#include "xmlwriter.h"
+#include "userlist.h"
+#include "user.h"
+#include "epoch.h"
+
+// Compares saving the forum as XML through xmlWriter with building a rapidxml document of it and printing
+// that, which is how it was saved before. Both save the users and the posts, the time and the memory
+// needed on top of the loaded forum are shown.
+// Usage: savebench [posts] [bytes of text per post], 200000 posts of 300 bytes by default
+
+namespace {
+
+	const char* STREAMED_FILE = "savebench_streamed.xml";
+	const char* DOCUMENT_FILE = "savebench_document.xml";
+
+	typedef std::vector<std::shared_ptr<std::string>> keptStrings; // Values the document points to
+
+	rapidxml::xml_attribute<>* numberAttribute(rapidxml::xml_document<>& document, keptStrings& strings, const char* name, long long int value) {
+		strings.push_back(std::make_shared<std::string>(std::to_string(value)));
+		return document.allocate_attribute(name, strings.back()->c_str());
+	}
+
+	rapidxml::xml_node<>* postNode(rapidxml::xml_document<>& document, keptStrings& strings, std::shared_ptr<lightforums::post> from, const lightforums::epochs::snapshot& view) {
+		std::shared_ptr<lightforums::postVersion> saved = from->versionAt(view);
+		rapidxml::xml_node<>* made = document.allocate_node(rapidxml::node_element, "post");
+		made->append_attribute(document.allocate_attribute("title", saved->title->data(), 0, saved->title->size()));
+		made->append_attribute(document.allocate_attribute("author", saved->author->c_str()));
+		if (saved->pin) made->append_attribute(document.allocate_attribute("pin", saved->pin->c_str()));
+		made->append_attribute(numberAttribute(document, strings, "id", from->getId()));
+		made->append_attribute(numberAttribute(document, strings, "uid", from->getUid()));
+		made->append_attribute(numberAttribute(document, strings, "visibility", saved->visibility));
+		made->append_attribute(numberAttribute(document, strings, "depth", saved->depth));
+		made->append_attribute(numberAttribute(document, strings, "posted_at", from->postedAt_.load()));
+		made->append_attribute(numberAttribute(document, strings, "sort_by", saved->sortBy));
+		made->append_node(document.allocate_node(rapidxml::node_element, "text", saved->text->data(), 0, saved->text->size()));
+		std::vector<std::shared_ptr<lightforums::post>> children = from->childrenAt(view);
+		for (unsigned int i = 0; i < children.size(); i++) made->append_node(postNode(document, strings, children[i], view));
+		return made;
+	}
+
+	rapidxml::xml_node<>* userNode(rapidxml::xml_document<>& document, keptStrings& strings, std::shared_ptr<lightforums::user> from, const lightforums::epochs::snapshot& view) {
+		rapidxml::xml_node<>* made = document.allocate_node(rapidxml::node_element, "user");
+		made->append_attribute(document.allocate_attribute("name", from->name_->c_str()));
+		made->append_attribute(document.allocate_attribute("password", from->password_->c_str()));
+		made->append_attribute(document.allocate_attribute("salt", from->salt_->c_str()));
+		made->append_attribute(numberAttribute(document, strings, "rank", from->rank_));
+		if (from->description_) made->append_node(document.allocate_node(rapidxml::node_element, "description", from->description_->c_str()));
+		rapidxml::xml_node<>* rated = document.allocate_node(rapidxml::node_element, "rated");
+		std::vector<std::pair<uint64_t, lightforums::rating>> ratings = from->ratingsAt(view);
+		for (unsigned int i = 0; i < ratings.size(); i++) {
+			strings.push_back(std::make_shared<std::string>(std::to_string(ratings[i].second)));
+			const char* name = strings.back()->c_str();
+			strings.push_back(std::make_shared<std::string>(std::to_string(ratings[i].first)));
+			rated->append_node(document.allocate_node(rapidxml::node_element, name, strings.back()->c_str()));
+		}
+		made->append_node(rated);
+		return made;
+	}
+
+	bool saveDocument(unsigned int users) {
+		lightforums::epochs::snapshot view;
+		rapidxml::xml_document<> document;
+		keptStrings strings;
+		rapidxml::xml_node<>* forums = document.allocate_node(rapidxml::node_element, "forums");
+		document.append_node(forums);
+		rapidxml::xml_node<>* usersNode = document.allocate_node(rapidxml::node_element, "users");
+		for (unsigned int i = 0; i < users; i++) {
+			std::shared_ptr<lightforums::user> saved = lightforums::userList::get().getUser("user" + std::to_string(i));
+			if (saved) usersNode->append_node(userNode(document, strings, saved, view));
+		}
+		forums->append_node(usersNode);
+		rapidxml::xml_node<>* posts = document.allocate_node(rapidxml::node_element, "posts");
+		posts->append_node(postNode(document, strings, root::get().getRootPost(), view));
+		forums->append_node(posts);
+		std::ofstream out(DOCUMENT_FILE);
+		out << document;
+		out.close();
+		return out.good();
+	}
+
+	bool saveStreamed() {
+		// Like saveStructures in main.cpp, without the settings, translations and cookies
+		lightforums::epochs::snapshot view;
+		lightforums::xmlWriter out;
+		if (!out.open(STREAMED_FILE)) return false;
+		out.startElement("forums");
+		lightforums::userList::get().save(out, view);
+		out.startElement("posts");
+		root::get().getRootPost()->save(out, view);
+		out.endElement();
+		out.endElement();
+		return out.finish();
+	}
+
+	void measure(const std::string& name, std::function<bool ()> save, const char* fileName) {
+		bench::resetPeakMemory();
+		long int before = bench::memoryKb("VmRSS");
+		auto start = std::chrono::steady_clock::now();
+		bool saved = save();
+		double took = bench::secondsSince(start);
+		long int peak = bench::memoryKb("VmHWM");
+		struct stat info;
+		long long int size = stat(fileName, &info) ? 0 : info.st_size;
+		std::cout << name << ": " << took << " s, " << (peak - before) / 1024 << " MB more at the peak, "
+				<< size / (1 << 20) << " MB written" << (saved ? "" : ", failed") << std::endl;
+		remove(fileName);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	unsigned int posts = argc > 1 ? atoi(argv[1]) : 200000;
+	size_t textSize = argc > 2 ? atoi(argv[2]) : 300;
+	unsigned int users = posts / 100 + 1;
+
+	std::string save = bench::makeSave(users, posts, 5, textSize);
+	bench::load(save);
+	std::string().swap(save);
+	std::cout << posts << " posts of " << textSize << " bytes, " << users << " users, " << bench::memoryKb("VmRSS") / 1024 << " MB loaded" << std::endl;
+
+	measure("xmlWriter", saveStreamed, STREAMED_FILE);
+	measure("rapidxml document", std::bind(saveDocument, users), DOCUMENT_FILE);
+	return 0;
+}
@@ -0,0 +1,93 @@
+#ifndef BINARYSTREAM_H
+#define BINARYSTREAM_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+namespace lightforums {
+
+	class binaryWriter {
+		// Accumulates little-endian binary data, numbers are written as LEB128 varints
+		std::string data_;
+	public:
+		void putByte(uint8_t byte) { data_.push_back((char)byte); }
+		void putVarint(uint64_t number) {
+			while (number >= 0x80) {
+				data_.push_back((char)((number & 0x7f) | 0x80));
+				number >>= 7;
+			}
+			data_.push_back((char)number);
+		}
+		void putFixed32(uint32_t number) {
+			for (int i = 0; i < 4; i++) data_.push_back((char)((number >> (i << 3)) & 0xff));
+		}
+		void putString(const char* str, size_t size) {
+			putVarint(size);
+			data_.append(str, size);
+		}
+		void putString(const std::string& str) { putString(str.c_str(), str.size()); }
+		void putRaw(const char* str, size_t size) { data_.append(str, size); }
+
+		const std::string& data() const { return data_; }
+		size_t size() const { return data_.size(); }
+		void clear() { data_.clear(); }
+	};
+
+	class binaryReader {
+		// Reads what binaryWriter wrote, running out of data or reading garbage sets the failed flag instead of throwing
+		const char* pos_;
+		const char* end_;
+		bool failed_;
+	public:
+		binaryReader(const char* from, size_t size) : pos_(from), end_(from + size), failed_(false) {}
+
+		uint8_t getByte() {
+			if (pos_ >= end_) {
+				failed_ = true;
+				return 0;
+			}
+			return (uint8_t)*pos_++;
+		}
+		uint64_t getVarint() {
+			uint64_t result = 0;
+			for (int shift = 0; shift < 64; shift += 7) {
+				uint8_t got = getByte();
+				result |= (uint64_t)(got & 0x7f) << shift;
+				if (!(got & 0x80)) return result;
+			}
+			failed_ = true;
+			return 0;
+		}
+		uint32_t getFixed32() {
+			uint32_t result = 0;
+			for (int i = 0; i < 4; i++) result |= (uint32_t)getByte() << (i << 3);
+			return result;
+		}
+		// Returns a pointer into the read buffer, valid as long as the buffer is
+		const char* getRaw(size_t size) {
+			if ((size_t)(end_ - pos_) < size) {
+				failed_ = true;
+				pos_ = end_;
+				return nullptr;
+			}
+			const char* result = pos_;
+			pos_ += size;
+			return result;
+		}
+		std::string getString() {
+			size_t size = getVarint();
+			const char* got = getRaw(size);
+			if (!got) return std::string();
+			return std::string(got, size);
+		}
+
+		const char* position() const { return pos_; }
+		size_t remaining() const { return end_ - pos_; }
+		bool atEnd() const { return pos_ >= end_; }
+		bool failed() const { return failed_; }
+	};
+
+}
+
+#endif // BINARYSTREAM_H
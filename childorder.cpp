@@ -0,0 +1,94 @@
+#include "childorder.h"
+#include "post.h"
+#include <algorithm>
+
+bool lightforums::childOrder::key::operator<(const key& other) const {
+	if (pin) {
+		if (!other.pin) return true;
+		if (*pin != *other.pin) return *pin < *other.pin;
+	} else if (other.pin) return false;
+	if (time != other.time) return time > other.time;
+	return id > other.id;
+}
+
+lightforums::childOrder::childOrder() :
+	built_(false)
+{
+}
+
+void lightforums::childOrder::insert(const std::shared_ptr<post>& child) {
+	placed keys;
+	keys.byActivity.pin = keys.byPostTime.pin = std::atomic_load(&child->pin_);
+	keys.byActivity.time = child->lastActivity_;
+	keys.byPostTime.time = child->postedAt_;
+	keys.byActivity.id = keys.byPostTime.id = child->getId();
+	byActivity_[keys.byActivity] = child;
+	byPostTime_[keys.byPostTime] = child;
+	keys_[child->getId()] = keys;
+}
+
+void lightforums::childOrder::build(post* parent) {
+	for (auto it = parent->children_.begin(); it != parent->children_.end(); it++) insert(it->second);
+	built_ = true;
+}
+
+void lightforums::childOrder::added(std::shared_ptr<post> child) {
+	std::lock_guard<std::mutex> guard(lock_);
+	if (!built_) return; // It will be there when it's built
+	erase(child->getId());
+	insert(child);
+}
+
+void lightforums::childOrder::removed(unsigned int id) {
+	std::lock_guard<std::mutex> guard(lock_);
+	erase(id);
+}
+
+void lightforums::childOrder::changed(post* child) {
+	std::lock_guard<std::mutex> guard(lock_);
+	if (!built_) return;
+	auto found = keys_.find(child->getId());
+	if (found == keys_.end()) return;
+	std::shared_ptr<post> kept = byActivity_[found->second.byActivity];
+	erase(child->getId());
+	insert(kept);
+}
+
+void lightforums::childOrder::erase(unsigned int id) {
+	auto found = keys_.find(id);
+	if (found == keys_.end()) return;
+	byActivity_.erase(found->second.byActivity);
+	byPostTime_.erase(found->second.byPostTime);
+	keys_.erase(found);
+}
+
+lightforums::childOrder::page lightforums::childOrder::getPage(post* parent, sortPosts by, const key* cursor, bool backwards, unsigned int count) {
+	std::lock_guard<std::mutex> guard(lock_);
+	if (!built_) build(parent);
+	// Not sorting somehow has no order of its own, the order of posting is used to keep the pages stable
+	std::map<key, std::shared_ptr<post>>& order = (by == SORT_BY_ACTIVITY) ? byActivity_ : byPostTime_;
+	page result;
+	result.posts.reserve(std::min<size_t>(count, order.size()));
+	result.keys.reserve(result.posts.capacity());
+	if (!backwards) {
+		auto it = cursor ? order.upper_bound(*cursor) : order.begin();
+		result.before = (it != order.begin());
+		for ( ; it != order.end() && result.posts.size() < count; it++) {
+			result.posts.push_back(it->second);
+			result.keys.push_back(it->first);
+		}
+		result.after = (it != order.end());
+	} else {
+		auto it = cursor ? order.lower_bound(*cursor) : order.end();
+		result.after = (it != order.end());
+		while (it != order.begin() && result.posts.size() < count) {
+			it--;
+			result.posts.push_back(it->second);
+			result.keys.push_back(it->first);
+		}
+		result.before = (it != order.begin());
+		std::reverse(result.posts.begin(), result.posts.end());
+		std::reverse(result.keys.begin(), result.keys.end());
+	}
+	return result;
+}
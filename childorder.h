@@ -0,0 +1,66 @@
+#ifndef CHILDORDER_H
+#define CHILDORDER_H
+
+#include <memory>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <ctime>
+#include "defines.h"
+
+namespace lightforums {
+
+	class post;
+
+	class childOrder {
+		// Children of a post in the order they are shown, pinned ones first (by pin), then the newest first.
+		// It's built when it's first needed, from then on it's updated when a child is added, removed or changes
+		// its activity or pin, so that showing the first few doesn't need sorting all of them.
+	public:
+		struct key {
+			std::shared_ptr<std::string> pin;
+			time_t time;
+			unsigned int id;
+			bool operator<(const key& other) const;
+		};
+		struct page {
+			std::vector<std::shared_ptr<post>> posts;
+			std::vector<key> keys; // Where each of the posts is, usable as cursors
+			bool before; // There are more in front of the page
+			bool after; // There are more behind the page
+		};
+
+		childOrder();
+
+		void added(std::shared_ptr<post> child);
+		void removed(unsigned int id);
+		void changed(post* child); // Its activity or pin is different
+		// Up to count children right behind the cursor (or in front of it if backwards), from the start if there is no cursor.
+		// The cursor is a position in the order, not an offset, so pages don't shift when children are added or move up.
+		page getPage(post* parent, sortPosts by, const key* cursor, bool backwards, unsigned int count);
+
+	private:
+		struct placed {
+			key byActivity;
+			key byPostTime;
+		};
+
+		void build(post* parent);
+		void erase(unsigned int id);
+		void insert(const std::shared_ptr<post>& child);
+
+		std::mutex lock_;
+		bool built_;
+		std::map<key, std::shared_ptr<post>> byActivity_;
+		std::map<key, std::shared_ptr<post>> byPostTime_;
+		std::unordered_map<unsigned int, placed> keys_;
+
+		childOrder(const childOrder&) = delete;
+		void operator=(const childOrder&) = delete;
+	};
+
+}
+
+#endif // CHILDORDER_H
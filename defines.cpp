@@ -18,269 +18,95 @@
 #include <Wt/WHBoxLayout>
 #include "settings.h"
 #include "translation.h"
-
-void lightforums::formatString(const std::string& str, Wt::WContainerWidget* into) {
-	enum markup : unsigned int {
-		PLAIN = 0x0,
-		HEADING = 0x1,
-		SPOILER = 0x2,
-		ITALIC = 0x4,
-		BOLD = 0x8,
-		CODE = 0x10,
-		STRIKETHROUGH = 0x20,
-		SUBSCRIPT = 0x40,
-		SUPERSCRIPT = 0x80,
-		LINK = 0x100,
-	};
-	struct node {
-		markup style;
-		std::string text;
-		std::string path;
-		std::vector<node> deeper;
-		node(const std::string& source, markup styleOutside = PLAIN, std::string linkPath = "") : style(styleOutside) {
-			if (styleOutside == CODE) {
-				text = source;
-				return;
-			}
-			path = linkPath;
-			std::pair<char, markup> pairMarkups[] = {{'_', ITALIC}, {'*', BOLD}, {'-', STRIKETHROUGH}, {'^', SUPERSCRIPT}, {'~', SUBSCRIPT}};
-			auto getMarkup = [&] (const char character) -> markup {
-				for (int i = 0; i < 5; i++) if (character == pairMarkups[i].first) return pairMarkups[i].second;
-				return PLAIN; // PLAIN == 0 == false
-			};
-
-			std::string soFar;
-			auto pushSoFar = [&] () -> void {
-				if (soFar.empty()) return;
-				deeper.push_back(node(soFar, PLAIN));
-				soFar.clear();
-			};
-			auto increment = [&] (const char*& str) { // special decrement/increment to deal with code
-				str++;
-				if (*str == '`' && (str == source.c_str() || str[-1] != '//')) {
-					do str++; while (*str && (*str != '`' || (str[-1] != '//')));
-					str++;
-				}
-			};
-			auto decrement = [&] (const char*& str) {
-				if (str > source.c_str()) str--;
-				if (*str == '`' && str[-1] != '\\') {
-					do str--; while ((*str != '`' || (str != source.c_str() && str[-1] != '//')) && str >= source.c_str());
-					str--;
-				}
-			};
-
-			for (const char* str = source.c_str(); *str; str++) {
-				if ((str == source.c_str() || str[-1] == '\n') && *str == '!') {
-					pushSoFar();
-					const char* strIn = str + 1;
-					for ( ; *strIn && (*strIn != '\n' || strIn[-1] == '\\'); increment(strIn)) {
-						soFar.push_back(*strIn);
-					}
-					if (!*strIn) continue;
-					deeper.push_back(node(soFar, HEADING, path));
-					soFar.clear();
-					str = strIn;
-				} else if ((str == source.c_str() || str[-1] != '\\') && *str == '{') {
-					pushSoFar();
-					const char* strIn = str + 1;
-					int depth = 0;
-					for ( ; *strIn; increment(strIn)) {
-						if (*strIn == '{' && strIn[-1] != '\\') depth++;
-						if (*strIn == '}' && strIn[-1] != '\\') {
-							if (!depth) break;
-							else depth--;
-						}
-						soFar.push_back(*strIn);
-					}
-					if (!*strIn) continue;
-					deeper.push_back(node(soFar, SPOILER, path));
-					soFar.clear();
-					str = strIn;
-				}
-				else if ((str == source.c_str() || str[-1] != '\\') && *str == '[') {
-					pushSoFar();
-					const char* strIn = str + 1;
-					int depth = 0;
-					for ( ; *strIn; increment(strIn)) {
-						if (*strIn == '[' && strIn[-1] != '\\') depth++;
-						if (*strIn == '|' && strIn[-1] != '\\') {
-							if (!depth) break;
-							else depth--;
-						}
-						soFar.push_back(*strIn);
-					}
-					if (!*strIn) continue;
-					str = strIn + 1;
-					std::string foundPath;
-					for ( ; *str && *str != ']'; str++) foundPath.push_back(*str);
-					deeper.push_back(node(soFar, LINK, foundPath));
-					soFar.clear();
-				} else {
-					if (str == source.c_str() || str[-1] == ' ' || str[-1] == '\t' || str[-1] == '\n') {
-						markup got = getMarkup(*str);
-						if (got) {
-							bool isMarkup = false;
-							for (const char* innerIt = str + 1; *innerIt != ' ' && *innerIt != '\t' && *innerIt != '\n'; increment(innerIt)) {
-								if (!getMarkup(*innerIt)) {
-									isMarkup = true;
-									break;
-								}
-							}
-							if (isMarkup) {
-								for (const char* innerIt = str; *innerIt; increment(innerIt)) {
-									if (*innerIt == *str && (innerIt[1] == ' ' || innerIt[1] == '\t' || innerIt[1] == '\n' || innerIt[1] == '.' || innerIt[1] == ','
-															 || innerIt[1] == ';' || innerIt[1] == '?' || innerIt[1] == '!' || innerIt[1] == 0) && innerIt[-1] != '\\') {
-										isMarkup = false;
-										for (const char* innerInnerIt = innerIt; innerInnerIt > str; decrement(innerInnerIt)) {
-											if (*innerIt == ' ' || *innerIt == '\n' || *innerIt == '\t') break;
-											else if (!getMarkup(*innerInnerIt)) {
-												isMarkup = true;
-												break;
-											}
-										}
-										if (isMarkup) {
-											std::string added;
-											for ( str++ ; str != innerIt; increment(str)) added.push_back(*str);
-											pushSoFar();
-											deeper.push_back(node(added, got));
-											break;
-										} else soFar.push_back(*str);
-									}
-								}
-								continue;
-							}
-						}
-					}
-					if (*str == '`' && (str == source.c_str() || str[-1] != '\\')) {
-						str++;
-						std::string added;
-						for ( ; *str != '`'; str++) added.push_back(*str);
-						pushSoFar();
-						deeper.push_back(node(added, CODE));
-					} else soFar.push_back(*str);
-				}
-			}
-
-			if (deeper.empty()) text.swap(soFar);
-			else pushSoFar();
-		}
-		void chew() {
-			if (text.empty()) {
-				for (unsigned int i = 0; i < deeper.size(); i++) deeper[i].chew();
-			} else {
-				std::string newText;
-				for (const char* str = text.c_str(); *str; str++) {
-					if (*str == '\n') {
-						newText.append("<br/>");
-					} else if (*str == '\\' && str[1] == '\\') {
-						newText.push_back('\\');
-						str++;
-					} else if (*str == ' ' && str[1] == ' ') {
-						newText.append("&nbsp;");
-						str++;
-					} else if (*str == '<') {
-						newText.append("&lt;");
-					} else if (*str == '>') {
-						newText.append("&gt;");
-					} else if (*str == '&') {
-						newText.append("&#38;");
-					} else if (*str == '"') {
-						newText.append("&#34;");
-					} else if (*str == '\'') {
-						newText.append("&#39;");
-					} else if (*str == '\\' && (str[1] == '_' || str[1] == '*' || str[1] == '-' || str[1] == '~' || str[1] == '-' || str[1] == '`' || str[1] == '!' || str[1] == '{' || str[1] == '}' || str[1] == ']' || str[1] == '|')) {}
-					else newText.push_back(*str);
-				}
-				text.swap(newText);
-			}
-		}
-
-		void construct(Wt::WContainerWidget *into, unsigned int flags = 0x0) {
-			if (deeper.empty()) {
-				std::string prefix;
-				std::string suffix;
-				if (flags & CODE) { prefix += "<tt>"; suffix = "</tt>" + suffix; }
-				if (flags & ITALIC) { prefix += "<em>"; suffix = "</em>" + suffix; }
-				if (flags & BOLD) { prefix += "<strong>"; suffix = "</strong>"  + suffix; }
-				if (flags & STRIKETHROUGH) { prefix += "<strike>"; suffix = "</strike>" + suffix; }
-				if (flags & SUPERSCRIPT) { prefix += "<sup>"; suffix = "</sup>" + suffix; }
-				if (flags & SUBSCRIPT) { prefix += "<sub>"; suffix = "</sub>" + suffix; }
-				if (flags & HEADING) { prefix += "<h1>"; suffix = "</h1>" + suffix; }
-				if (flags & LINK) {
-					new Wt::WAnchor(Wt::WLink(path), Wt::WString(prefix + text + suffix), into);
-				} else new Wt::WText(Wt::WString(prefix + text + suffix), into);
-			} else {
-				for (unsigned int i = 0; i < deeper.size(); i++) {
-					if (deeper[i].style == PLAIN) deeper[i].construct(into, flags); // Most common, let it be dealt with easily
-					else if (deeper[i].style == SPOILER) {
-						Wt::WPanel* panel = new Wt::WPanel(into);
-						panel->setTitle(Wt::WString(*tr::get(tr::SPOILER_TITLE)));
-						panel->setCollapsible(true);
-						Wt::WAnimation animation(Wt::WAnimation::SlideInFromTop, Wt::WAnimation::EaseOut, 100);
-						panel->setAnimation(animation);
-						Wt::WContainerWidget* container = new Wt::WContainerWidget(into);
-						deeper[i].construct(container, flags);
-						panel->setCentralWidget(container);
-						panel->setCollapsed(true);
-					} else {
-						deeper[i].construct(into, flags ^ deeper[i].style);
-					}
-				}
-			}
+#include "rendercache.h"
+#include <thread>
+
+void lightforums::showRendered(const renderedText& rendered, Wt::WContainerWidget* into) {
+	if (Settings::get().singleWidgetPosts) {
+		// Hundreds of widgets in every session that sees a long post are replaced by one
+		std::string html;
+		rendered.wholeHtml(tr::get(tr::SPOILER_TITLE), html);
+		new Wt::WText(Wt::WString(html), into);
+		return;
+	}
+	std::vector<std::pair<Wt::WPanel*, Wt::WContainerWidget*>> spoilers;
+	for (unsigned int i = 0; i < rendered.ops.size(); i++) {
+		const renderedText::op& shown = rendered.ops[i];
+		Wt::WContainerWidget* container = spoilers.empty() ? into : spoilers.back().second;
+		if (shown.type == renderedText::HTML) {
+			new Wt::WText(Wt::WString(rendered.html(shown)), container);
+		} else if (shown.type == renderedText::LINK) {
+			new Wt::WAnchor(Wt::WLink(rendered.path(shown)), Wt::WString(rendered.html(shown)), container);
+		} else if (shown.type == renderedText::SPOILER_START) {
+			Wt::WPanel* panel = new Wt::WPanel(container);
+			panel->setTitle(Wt::WString(tr::get(tr::SPOILER_TITLE)));
+			panel->setCollapsible(true);
+			Wt::WAnimation animation(Wt::WAnimation::SlideInFromTop, Wt::WAnimation::EaseOut, 100);
+			panel->setAnimation(animation);
+			spoilers.push_back(std::make_pair(panel, new Wt::WContainerWidget(container)));
+		} else if (shown.type == renderedText::SPOILER_END && !spoilers.empty()) {
+			spoilers.back().first->setCentralWidget(spoilers.back().second);
+			spoilers.back().first->setCollapsed(true);
+			spoilers.pop_back();
 		}
-	};
+	}
+}
 
-	node parsed(str);
-	parsed.chew();
-	parsed.construct(into);
+void lightforums::formatString(const std::string& str, Wt::WContainerWidget* into) {
+	renderedText rendered;
+	renderString(str, rendered);
+	showRendered(rendered, into);
 }
 
-Wt::WInPlaceEdit* lightforums::makeEditableText(std::shared_ptr<std::string>* target, Wt::WContainerWidget* parent) {
+Wt::WInPlaceEdit* lightforums::makeEditableText(std::shared_ptr<std::string>* target, Wt::WContainerWidget* parent, std::function<void ()> onChange) {
 	Wt::WInPlaceEdit* result = new Wt::WInPlaceEdit(*target ? *std::atomic_load(target) : "", parent);
-	result->setPlaceholderText(Wt::WString(*tr::get(tr::DONT_KEEP_THIS_EMPTY)));
-	result->saveButton()->setText(Wt::WString(*tr::get(tr::SAVE_CHANGES)));
+	result->setPlaceholderText(Wt::WString(tr::get(tr::DONT_KEEP_THIS_EMPTY)));
+	result->saveButton()->setText(Wt::WString(tr::get(tr::SAVE_CHANGES)));
 	result->saveButton()->clicked().connect(std::bind([=] () {
 		std::atomic_store(target, std::make_shared<std::string>(result->text().toUTF8()));
+		if (onChange) onChange();
 	}));
-	result->cancelButton()->setText(Wt::WString(*tr::get(tr::DISCARD_CHANGES)));
-	result->setToolTip(Wt::WString(*tr::get(tr::CLICK_TO_EDIT)));
+	result->cancelButton()->setText(Wt::WString(tr::get(tr::DISCARD_CHANGES)));
+	result->setToolTip(Wt::WString(tr::get(tr::CLICK_TO_EDIT)));
 	return result;
 }
 
-Wt::WInPlaceEdit* lightforums::makeEditableNumber(unsigned long int* target, Wt::WContainerWidget* parent) {
+Wt::WInPlaceEdit* lightforums::makeEditableNumber(unsigned long int* target, Wt::WContainerWidget* parent, std::function<void ()> onChange) {
 	Wt::WInPlaceEdit* result = new Wt::WInPlaceEdit(std::to_string(*target), parent);
-	result->setPlaceholderText(Wt::WString(*tr::get(tr::DONT_KEEP_THIS_EMPTY)));
-	result->saveButton()->setText(Wt::WString(*tr::get(tr::SAVE_CHANGES)));
+	result->setPlaceholderText(Wt::WString(tr::get(tr::DONT_KEEP_THIS_EMPTY)));
+	result->saveButton()->setText(Wt::WString(tr::get(tr::SAVE_CHANGES)));
 	result->saveButton()->clicked().connect(std::bind([=] () {
 		*target = std::stoi(result->text().toUTF8());
+		if (onChange) onChange();
 	}));
-	result->cancelButton()->setText(Wt::WString(*tr::get(tr::DISCARD_CHANGES)));
-	result->setToolTip(Wt::WString(*tr::get(tr::CLICK_TO_EDIT)));
+	result->cancelButton()->setText(Wt::WString(tr::get(tr::DISCARD_CHANGES)));
+	result->setToolTip(Wt::WString(tr::get(tr::CLICK_TO_EDIT)));
 	return result;
 }
 
-Wt::WInPlaceEdit* lightforums::makeEditableNumber(unsigned int* target, Wt::WContainerWidget* parent) {
+Wt::WInPlaceEdit* lightforums::makeEditableNumber(unsigned int* target, Wt::WContainerWidget* parent, std::function<void ()> onChange) {
 	Wt::WInPlaceEdit* result = new Wt::WInPlaceEdit(std::to_string(*target), parent);
-	result->setPlaceholderText(Wt::WString(*tr::get(tr::DONT_KEEP_THIS_EMPTY)));
-	result->saveButton()->setText(Wt::WString(*tr::get(tr::SAVE_CHANGES)));
+	result->setPlaceholderText(Wt::WString(tr::get(tr::DONT_KEEP_THIS_EMPTY)));
+	result->saveButton()->setText(Wt::WString(tr::get(tr::SAVE_CHANGES)));
 	result->saveButton()->clicked().connect(std::bind([=] () {
 		*target = std::stoi(result->text().toUTF8());
+		if (onChange) onChange();
 	}));
-	result->cancelButton()->setText(Wt::WString(*tr::get(tr::DISCARD_CHANGES)));
-	result->setToolTip(Wt::WString(*tr::get(tr::CLICK_TO_EDIT)));
+	result->cancelButton()->setText(Wt::WString(tr::get(tr::DISCARD_CHANGES)));
+	result->setToolTip(Wt::WString(tr::get(tr::CLICK_TO_EDIT)));
 	return result;
 }
 
-Wt::WComboBox* lightforums::makeEnumEditor(unsigned char* changed, unsigned char elements, unsigned int first, Wt::WContainerWidget* parent) {
+Wt::WComboBox* lightforums::makeEnumEditor(unsigned char* changed, unsigned char elements, unsigned int first, Wt::WContainerWidget* parent, std::function<void ()> onChange) {
 	Wt::WComboBox* result = new Wt::WComboBox(parent);
 	for (unsigned int i = 0; i < elements; i++) {
-		result->addItem(*tr::get((tr::translatable)(first + i)));
+		result->addItem(tr::get((tr::translatable)(first + i)));
 	}
 
 	result->setCurrentIndex(*changed);
 	result->changed().connect(std::bind([=] () {
 		*changed = result->currentIndex();
+		if (onChange) onChange();
 	}));
 	return result;
 }
@@ -292,8 +118,8 @@ namespace lightforums {
 		//model->setItemPrototype(new NumericItem());
 
 		model->insertColumns(model->columnCount(), 2);
-		model->setHeaderData(0, Wt::WString(*tr::get(tr::RATING_TITLE)));
-		model->setHeaderData(1, Wt::WString(*tr::get(tr::RATING_VALUE)));
+		model->setHeaderData(0, Wt::WString(tr::get(tr::RATING_TITLE)));
+		model->setHeaderData(1, Wt::WString(tr::get(tr::RATING_VALUE)));
 
 		Settings& settings = Settings::get();
 		std::vector<rating> available;
@@ -302,7 +128,7 @@ namespace lightforums {
 		}
 		model->insertRows(model->rowCount(), available.size());
 		for (unsigned int i = 0; i < available.size(); i++) {
-			model->setData(i, 0, Wt::WString(*tr::get((tr::translatable)(tr::RATE_USEFUL + available[i]))));
+			model->setData(i, 0, Wt::WString(tr::get((tr::translatable)(tr::RATE_USEFUL + available[i]))));
 			model->setData(i, 1, data[available[i]].load());
 		}
 
@@ -365,7 +191,7 @@ Wt::WText* lightforums::makeRatingOverview(const std::atomic_int* data, Wt::WCon
 			max = data[i];
 		}
 	}
-	if (sum == 0) return new Wt::WText(Wt::WString(*tr::get(tr::NOT_RATED_YET)), parent);
+	if (sum == 0) return new Wt::WText(Wt::WString(tr::get(tr::NOT_RATED_YET)), parent);
 	int goodPercentage = (good * 100) / sum;
 
 	std::string text;
@@ -373,7 +199,7 @@ Wt::WText* lightforums::makeRatingOverview(const std::atomic_int* data, Wt::WCon
 		Wt::WColor colour = getColour(Settings::get().rateColour[predominant]);
 		text += "<font color=\"rgb(" + std::to_string(colour.red()) + "," + std::to_string(colour.green()) + "," + std::to_string(colour.blue()) + "\">";
 	}
-	text += replaceVar(*tr::get(tr::RATED_AS_X), 'X', goodPercentage);
+	text += replaceVar(tr::get(tr::RATED_AS_X), 'X', goodPercentage);
 	if (Settings::get().colouriseSmallRating) text += "</font>";
 	return new Wt::WText(Wt::WString(text), parent);
 }
@@ -390,7 +216,7 @@ void lightforums::messageBox(const std::string& title, const std::string& text)
 	layout->addWidget(buttonContainer);
 	Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(buttonContainer);
 	buttonLayout->addStretch(1);
-	Wt::WPushButton* okButton = new Wt::WPushButton(Wt::WString(*tr::get(tr::GENERIC_OK)), buttonContainer);
+	Wt::WPushButton* okButton = new Wt::WPushButton(Wt::WString(tr::get(tr::GENERIC_OK)), buttonContainer);
 	okButton->setDefault(true);
 	buttonLayout->addWidget(okButton);
 	buttonLayout->addStretch(1);
@@ -415,11 +241,11 @@ void lightforums::areYouSureBox(const std::string& title, const std::string& tex
 	Wt::WContainerWidget* buttonContainer = new Wt::WContainerWidget(dialog->contents());
 	layout->addWidget(buttonContainer);
 	Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(buttonContainer);
-	Wt::WPushButton* continueButton = new Wt::WPushButton(Wt::WString(*tr::get(tr::GENERIC_CONTINUE)), buttonContainer);
+	Wt::WPushButton* continueButton = new Wt::WPushButton(Wt::WString(tr::get(tr::GENERIC_CONTINUE)), buttonContainer);
 	continueButton->setDefault(true);
 	buttonLayout->addWidget(continueButton);
 	buttonLayout->addStretch(1);
-	Wt::WPushButton* cancelButton = new Wt::WPushButton(Wt::WString(*tr::get(tr::GENERIC_CANCEL)), buttonContainer);
+	Wt::WPushButton* cancelButton = new Wt::WPushButton(Wt::WString(tr::get(tr::GENERIC_CANCEL)), buttonContainer);
 	cancelButton->setDefault(true);
 	buttonLayout->addWidget(cancelButton);
 
@@ -540,3 +366,15 @@ std::string lightforums::fromBase64(const std::string& from) {
 	}
 	return result;
 }
+
+void lightforums::runInParallel(const std::vector<std::function<void ()>>& tasks) {
+	std::atomic_uint next(0);
+	auto work = [&] () {
+		for (unsigned int taken = next++; taken < tasks.size(); taken = next++) tasks[taken]();
+	};
+	unsigned int threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)tasks.size()));
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; i++) threads.emplace_back(work);
+	work(); // This thread helps too
+	for (unsigned int i = 0; i < threads.size(); i++) threads[i].join();
+}
@@ -6,9 +6,11 @@
 #include <vector>
 #include <random>
 #include <atomic>
+#include <functional>
 
 #define ALL_PATH_PREFIX "?_="
 #define POST_PATH_PREFIX "post"
+#define POST_ID_PREFIX "id"
 #define USER_PATH_PREFIX "user"
 #define SETTINGS_PATH "settings"
 #define TRANSLATION_PATH "translation"
@@ -37,6 +39,7 @@ namespace Wt {
 namespace lightforums {
 
 	class user;
+	class xmlWriter;
 
 	enum rank : unsigned char {
 		USER, // Standard rights
@@ -80,22 +83,26 @@ namespace lightforums {
 		sortPostsSize
 	};
 
-	void formatString(const std::string& str, Wt::WContainerWidget* into);
+	struct renderedText;
+	bool renderString(const std::string& str, renderedText& into); // False if it had no markup
+	void showRendered(const renderedText& rendered, Wt::WContainerWidget* into);
+	void formatString(const std::string& str, Wt::WContainerWidget* into); // Both of the above, for texts that aren't cached
 	std::string replaceVar(const std::string& str, char X, int x);
 	inline std::string replaceVar(std::shared_ptr<const std::string> str, char X, int x) { return replaceVar(*str, X, x); }
 	std::string replaceVar(const std::string& str, char X, const std::string& x);
 	inline std::string replaceVar(std::shared_ptr<const std::string> str, char X, const std::string& x) { return replaceVar(*str, X, x); }
 	std::vector<std::string> splitString(const std::string& splitted, char delimeter);
-	Wt::WInPlaceEdit* makeEditableText(std::shared_ptr<std::string>* target, Wt::WContainerWidget* parent); // Pointer to the shared_ptr that will be changed by editing
-	Wt::WInPlaceEdit* makeEditableNumber(unsigned long int* target, Wt::WContainerWidget* parent);
-	Wt::WInPlaceEdit* makeEditableNumber(unsigned int* target, Wt::WContainerWidget* parent);
-	Wt::WComboBox* makeEnumEditor(unsigned char* changed, unsigned char elements, unsigned int first, Wt::WContainerWidget* parent);
+	Wt::WInPlaceEdit* makeEditableText(std::shared_ptr<std::string>* target, Wt::WContainerWidget* parent, std::function<void ()> onChange = nullptr); // Pointer to the shared_ptr that will be changed by editing
+	Wt::WInPlaceEdit* makeEditableNumber(unsigned long int* target, Wt::WContainerWidget* parent, std::function<void ()> onChange = nullptr);
+	Wt::WInPlaceEdit* makeEditableNumber(unsigned int* target, Wt::WContainerWidget* parent, std::function<void ()> onChange = nullptr);
+	Wt::WComboBox* makeEnumEditor(unsigned char* changed, unsigned char elements, unsigned int first, Wt::WContainerWidget* parent, std::function<void ()> onChange = nullptr);
 	Wt::Chart::WPieChart* makeRatingChart(const std::atomic_int* data, Wt::WContainerWidget* parent);
 	Wt::WText* makeRatingOverview(const std::atomic_int* data, Wt::WContainerWidget* parent);
 	const Wt::WColor& getColour(colour col);
 	void messageBox(const std::string& title, const std::string& text);
 	void areYouSureBox(const std::string& title, const std::string& text, std::function<void ()> acceptFunc, std::function<void ()> rejectFunc = nullptr);
 
+	void runInParallel(const std::vector<std::function<void ()>>& tasks); // Returns when all are done, larger tasks should go first
 	std::string toBase64(const std::string& from);
 	std::string fromBase64(const std::string& from);
 
@@ -0,0 +1,60 @@
+#include "epoch.h"
+
+#include <thread>
+#include "post.h"
+
+lightforums::epochs::epochs() :
+	current_(1),
+	activeSnapshots_(0)
+{
+	writing_[0] = 0;
+	writing_[1] = 0;
+}
+
+lightforums::epochs::writeScope::writeScope() {
+	epochs& parent = epochs::get();
+	while (true) {
+		epoch_ = parent.current_.load();
+		parent.writing_[epoch_ & 1]++;
+		if (parent.current_.load() == epoch_) break;
+		parent.writing_[epoch_ & 1]--; // A save started in between, this belongs to the next epoch
+	}
+}
+
+lightforums::epochs::writeScope::~writeScope() {
+	epochs::get().writing_[epoch_ & 1]--;
+}
+
+lightforums::epochs::snapshot::snapshot() {
+	epochs& parent = epochs::get();
+	std::lock_guard<std::mutex> lock(parent.snapshotLock_);
+	parent.activeSnapshots_++; // Must be visible before changes start using the new epoch
+	epoch_ = parent.current_.fetch_add(1);
+	// Changes stamped with this epoch might be half done, wait until they finish
+	// (if saves overlap, changes in the epoch after next are waited for as well, which is harmless)
+	while (parent.writing_[epoch_ & 1].load()) std::this_thread::yield();
+}
+
+lightforums::epochs::snapshot::~snapshot() {
+	epochs& parent = epochs::get();
+	std::lock_guard<std::mutex> lock(parent.snapshotLock_);
+	if (--parent.activeSnapshots_ == 0) std::atomic_store(&parent.retired_, std::shared_ptr<retiredPost>());
+}
+
+void lightforums::epochs::retire(std::shared_ptr<post> parent, std::shared_ptr<post> removed, uint64_t epoch) {
+	if (!snapshotsActive()) return;
+	std::shared_ptr<retiredPost> made = std::make_shared<retiredPost>();
+	made->parent = parent.get();
+	made->removed = removed;
+	made->epoch = epoch;
+	made->next = std::atomic_load(&retired_);
+	while (!std::atomic_compare_exchange_weak(&retired_, &made->next, made));
+}
+
+std::vector<std::shared_ptr<lightforums::post>> lightforums::epochs::retiredChildren(const post* parent, const snapshot& seenBy) {
+	std::vector<std::shared_ptr<post>> result;
+	for (std::shared_ptr<retiredPost> it = std::atomic_load(&retired_); it; it = it->next) {
+		if (it->parent == parent && !seenBy.sees(it->epoch)) result.push_back(it->removed);
+	}
+	return result;
+}
@@ -0,0 +1,73 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace lightforums {
+
+	class post;
+
+	class epochs {
+		// Lets saves see the forum as it was at one moment while it keeps changing. Every change is stamped
+		// with the current epoch and a save starts a new one. Before a change is made while a save is running,
+		// the previous state is kept aside, so the save can see it. The save waits only for changes that were
+		// already in progress when it started, changes never wait.
+	public:
+		static inline epochs& get() {
+			static epochs holder;
+			return holder;
+		}
+
+		class writeScope {
+			// Groups the changes of one action, they will all be seen by a save or none of them will
+			uint64_t epoch_;
+		public:
+			writeScope();
+			~writeScope();
+			uint64_t epoch() const { return epoch_; }
+			writeScope(const writeScope&) = delete;
+			void operator=(const writeScope&) = delete;
+		};
+
+		class snapshot {
+			uint64_t epoch_;
+		public:
+			snapshot();
+			~snapshot();
+			uint64_t epoch() const { return epoch_; }
+			bool sees(uint64_t stamp) const { return stamp <= epoch_; }
+			snapshot(const snapshot&) = delete;
+			void operator=(const snapshot&) = delete;
+		};
+
+		bool snapshotsActive() const { return activeSnapshots_.load() > 0; }
+		// Removed posts are remembered for saves that started before the removal
+		void retire(std::shared_ptr<post> parent, std::shared_ptr<post> removed, uint64_t epoch);
+		std::vector<std::shared_ptr<post>> retiredChildren(const post* parent, const snapshot& seenBy);
+
+	private:
+		epochs();
+
+		struct retiredPost {
+			const post* parent;
+			std::shared_ptr<post> removed;
+			uint64_t epoch;
+			std::shared_ptr<retiredPost> next;
+		};
+
+		std::atomic_uint_fast64_t current_;
+		std::atomic_uint_fast64_t writing_[2]; // Changes in progress in even and odd epochs
+		std::atomic_uint activeSnapshots_;
+		std::mutex snapshotLock_; // Taken only by saves
+		std::shared_ptr<retiredPost> retired_;
+
+		epochs(const epochs&) = delete;
+		void operator=(const epochs&) = delete;
+	};
+
+}
+
+#endif // EPOCH_H
@@ -0,0 +1,183 @@
+#include "escape.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIGHTFORUMS_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	typedef size_t (*finder)(const char*, size_t, lightforums::escaper::charset);
+
+	inline bool isSpace(char character) {
+		return character == ' ' || character == '\t' || character == '\n';
+	}
+
+	inline bool special(const char* data, const char* at, const char* end, lightforums::escaper::charset which) {
+		if (which == lightforums::escaper::MARKUP_START) {
+			switch (*at) {
+				case '{':
+				case '[':
+				case '`':
+					return true;
+				case '!':
+					return at == data || at[-1] == '\n';
+				case '_':
+				case '*':
+				case '-':
+				case '^':
+				case '~':
+					return at == data || isSpace(at[-1]);
+				default:
+					return false;
+			}
+		}
+		bool markup = (which == lightforums::escaper::MARKUP_SPECIAL);
+		switch (*at) {
+			case '<':
+			case '>':
+			case '&':
+			case '"':
+			case '\'':
+				return true;
+			case '\n':
+			case '\\':
+				return markup;
+			case ' ':
+				return markup && at + 1 < end && at[1] == ' ';
+			default:
+				return false;
+		}
+	}
+
+	size_t findScalar(const char* data, size_t size, lightforums::escaper::charset which, size_t from) {
+		const char* end = data + size;
+		for (const char* at = data + from; at < end; at++)
+			if (special(data, at, end, which)) return at - data;
+		return size;
+	}
+
+#ifdef LIGHTFORUMS_X86
+	// Double spaces are found by comparing the block with itself shifted by one, so markup needs one byte more.
+	// Markup starts depend on the character before, so that's checked with the block shifted the other way.
+	template <lightforums::escaper::charset which>
+	__attribute__((target("sse2"))) size_t findSse2(const char* data, size_t size, size_t at) {
+		if (which == lightforums::escaper::MARKUP_START && at == 0) {
+			if (size == 0 || special(data, data, data + size, which)) return 0;
+			at = 1;
+		}
+		for (; at + 16 + (which == lightforums::escaper::MARKUP_SPECIAL) <= size; at += 16) {
+			__m128i block = _mm_loadu_si128((const __m128i*)(data + at));
+			__m128i found;
+			if (which == lightforums::escaper::MARKUP_START) {
+				__m128i before = _mm_loadu_si128((const __m128i*)(data + at - 1));
+				__m128i lineStart = _mm_cmpeq_epi8(before, _mm_set1_epi8('\n'));
+				__m128i afterSpace = _mm_or_si128(lineStart, _mm_or_si128(_mm_cmpeq_epi8(before, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(before, _mm_set1_epi8('\t'))));
+				__m128i marks = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('_')), _mm_cmpeq_epi8(block, _mm_set1_epi8('*'))),
+											 _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('-')), _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('^')),
+																												 _mm_cmpeq_epi8(block, _mm_set1_epi8('~')))));
+				found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('{')), _mm_cmpeq_epi8(block, _mm_set1_epi8('['))),
+									 _mm_cmpeq_epi8(block, _mm_set1_epi8('`')));
+				found = _mm_or_si128(found, _mm_or_si128(_mm_and_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('!')), lineStart), _mm_and_si128(marks, afterSpace)));
+			} else {
+				found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('<')), _mm_cmpeq_epi8(block, _mm_set1_epi8('>'))),
+									 _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('&')), _mm_cmpeq_epi8(block, _mm_set1_epi8('"'))));
+				found = _mm_or_si128(found, _mm_cmpeq_epi8(block, _mm_set1_epi8('\'')));
+			}
+			if (which == lightforums::escaper::MARKUP_SPECIAL) {
+				__m128i next = _mm_loadu_si128((const __m128i*)(data + at + 1));
+				__m128i spaces = _mm_and_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(next, _mm_set1_epi8(' ')));
+				found = _mm_or_si128(found, _mm_or_si128(spaces, _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')),
+																			   _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')))));
+			}
+			unsigned int mask = _mm_movemask_epi8(found);
+			if (mask) return at + __builtin_ctz(mask);
+		}
+		return findScalar(data, size, which, at);
+	}
+
+	template <lightforums::escaper::charset which>
+	__attribute__((target("avx2"))) size_t findAvx2(const char* data, size_t size) {
+		size_t at = 0;
+		if (which == lightforums::escaper::MARKUP_START) {
+			if (size == 0 || special(data, data, data + size, which)) return 0;
+			at = 1;
+		}
+		for (; at + 32 + (which == lightforums::escaper::MARKUP_SPECIAL) <= size; at += 32) {
+			__m256i block = _mm256_loadu_si256((const __m256i*)(data + at));
+			__m256i found;
+			if (which == lightforums::escaper::MARKUP_START) {
+				__m256i before = _mm256_loadu_si256((const __m256i*)(data + at - 1));
+				__m256i lineStart = _mm256_cmpeq_epi8(before, _mm256_set1_epi8('\n'));
+				__m256i afterSpace = _mm256_or_si256(lineStart, _mm256_or_si256(_mm256_cmpeq_epi8(before, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(before, _mm256_set1_epi8('\t'))));
+				__m256i marks = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('*'))),
+												_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('-')), _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('^')),
+																																 _mm256_cmpeq_epi8(block, _mm256_set1_epi8('~')))));
+				found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('['))),
+										_mm256_cmpeq_epi8(block, _mm256_set1_epi8('`')));
+				found = _mm256_or_si256(found, _mm256_or_si256(_mm256_and_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('!')), lineStart), _mm256_and_si256(marks, afterSpace)));
+			} else {
+				found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('<')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('>'))),
+										_mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('&')), _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"'))));
+				found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\'')));
+			}
+			if (which == lightforums::escaper::MARKUP_SPECIAL) {
+				__m256i next = _mm256_loadu_si256((const __m256i*)(data + at + 1));
+				__m256i spaces = _mm256_and_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(next, _mm256_set1_epi8(' ')));
+				found = _mm256_or_si256(found, _mm256_or_si256(spaces, _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n')),
+																						_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')))));
+			}
+			unsigned int mask = _mm256_movemask_epi8(found);
+			if (mask) return at + __builtin_ctz(mask);
+		}
+		// The rest is shorter than a block, it's left to the narrower version
+		return findSse2<which>(data, size, at);
+	}
+
+	size_t chosenSse2(const char* data, size_t size, lightforums::escaper::charset which) {
+		switch (which) {
+			case lightforums::escaper::XML_SPECIAL: return findSse2<lightforums::escaper::XML_SPECIAL>(data, size, 0);
+			case lightforums::escaper::MARKUP_SPECIAL: return findSse2<lightforums::escaper::MARKUP_SPECIAL>(data, size, 0);
+			default: return findSse2<lightforums::escaper::MARKUP_START>(data, size, 0);
+		}
+	}
+
+	size_t chosenAvx2(const char* data, size_t size, lightforums::escaper::charset which) {
+		switch (which) {
+			case lightforums::escaper::XML_SPECIAL: return findAvx2<lightforums::escaper::XML_SPECIAL>(data, size);
+			case lightforums::escaper::MARKUP_SPECIAL: return findAvx2<lightforums::escaper::MARKUP_SPECIAL>(data, size);
+			default: return findAvx2<lightforums::escaper::MARKUP_START>(data, size);
+		}
+	}
+#endif
+
+	struct choice {
+		finder found;
+		const char* name;
+	};
+
+	const choice& chosen() {
+		static const choice made = [] () -> choice {
+#ifdef LIGHTFORUMS_X86
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return choice{chosenAvx2, "AVX2"};
+			if (__builtin_cpu_supports("sse2")) return choice{chosenSse2, "SSE2"};
+#endif
+			return choice{lightforums::escaper::findSpecialScalar, "scalar"};
+		}();
+		return made;
+	}
+
+}
+
+size_t lightforums::escaper::findSpecial(const char* data, size_t size, charset which) {
+	return chosen().found(data, size, which);
+}
+
+size_t lightforums::escaper::findSpecialScalar(const char* data, size_t size, charset which) {
+	return findScalar(data, size, which, 0);
+}
+
+const char* lightforums::escaper::implementation() {
+	return chosen().name;
+}
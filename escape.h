@@ -0,0 +1,29 @@
+#ifndef ESCAPE_H
+#define ESCAPE_H
+
+#include <cstddef>
+
+namespace lightforums {
+
+	class escaper {
+		// Finds the next character that can't be copied as it is, so everything before it can be copied at once,
+		// or the first one that can start markup, so texts without any can skip parsing.
+		// Texts are checked in blocks of 32 bytes with AVX2 or 16 with SSE2, whichever the processor can do.
+	public:
+		enum charset {
+			XML_SPECIAL, // < > & " '
+			MARKUP_SPECIAL, // Those and line breaks, backslashes and spaces followed by spaces
+			MARKUP_START // { [ ` anywhere, ! at the start of a line, _ * - ^ ~ at the start or after a space
+		};
+
+		static size_t findSpecial(const char* data, size_t size, charset which); // Returns size if there's none
+		static size_t findSpecialScalar(const char* data, size_t size, charset which); // What the others must match
+		static const char* implementation();
+
+	private:
+		escaper() = delete;
+	};
+
+}
+
+#endif // ESCAPE_H
@@ -0,0 +1,78 @@
+#include "escape.h"
+#include <string>
+#include <vector>
+#include <random>
+#include <iostream>
+
+// Checks that the vectorised search finds the same characters as the scalar one, for every charset,
+// at every size up to a few blocks and every alignment, around every character that matters.
+// The texts are copied into buffers of their exact size, so reading past the end is caught under ASan.
+
+namespace {
+
+	const lightforums::escaper::charset charsets[] = {
+		lightforums::escaper::XML_SPECIAL, lightforums::escaper::MARKUP_SPECIAL, lightforums::escaper::MARKUP_START
+	};
+	unsigned long int checks = 0;
+
+	bool agree(const std::string& text, size_t offset) {
+		std::vector<char> buffer(offset + text.size());
+		std::copy(text.begin(), text.end(), buffer.begin() + offset);
+		const char* data = buffer.data() + offset;
+		for (lightforums::escaper::charset which : charsets) {
+			size_t fast = lightforums::escaper::findSpecial(data, text.size(), which);
+			size_t scalar = lightforums::escaper::findSpecialScalar(data, text.size(), which);
+			checks++;
+			if (fast != scalar) {
+				std::cerr << lightforums::escaper::implementation() << " found " << fast << " instead of " << scalar
+						<< " in charset " << which << ", size " << text.size() << ", offset " << offset << ": " << text << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+}
+
+int main() {
+	std::cout << "Using " << lightforums::escaper::implementation() << std::endl;
+	const std::string interesting = "<>&\"'\n\\ \t{[`!_*-^~\x80\xff";
+
+	// One or two interesting characters in plain text, at every position and alignment
+	for (size_t size = 0; size <= 100; size++) {
+		for (size_t offset = 0; offset < 32; offset++) {
+			if (!agree(std::string(size, 'a'), offset)) return 1;
+			for (size_t at = 0; at < size; at++) {
+				for (char put : interesting) {
+					std::string text(size, 'a');
+					text[at] = put;
+					if (!agree(text, offset)) return 1;
+					if (at + 1 < size) {
+						text[at + 1] = ' ';
+						if (!agree(text, offset)) return 1;
+					}
+					if (at > 0) {
+						text[at - 1] = '\n';
+						if (!agree(text, offset)) return 1;
+					}
+				}
+			}
+		}
+	}
+
+	// Random texts of varying density
+	std::mt19937 random(1);
+	for (int round = 0; round < 300000; round++) {
+		size_t size = random() % 260;
+		unsigned int density = random() % 60 + 1;
+		std::string text(size, 'a');
+		for (size_t i = 0; i < size; i++) {
+			if (random() % density == 0) text[i] = interesting[random() % interesting.size()];
+			else text[i] = 'a' + random() % 26;
+		}
+		if (!agree(text, random() % 32)) return 1;
+	}
+
+	std::cout << checks << " searches agree" << std::endl;
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "markup.h"
+#include <string>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+// Measures how long the markup parser takes per byte of text, on texts made by repeating a pattern.
+// Usage: markupbench [megabytes], one by default
+
+namespace {
+
+	struct countingSink : public lightforums::markupSink {
+		size_t bytes = 0;
+		void addHtml(const std::string& html) override { bytes += html.size(); }
+		void addLink(const std::string& html, const char*, size_t pathSize) override { bytes += html.size() + pathSize; }
+		void addSpoiler(bool) override { bytes++; }
+	};
+
+	void measure(const std::string& name, const std::string& pattern, size_t size) {
+		std::string text;
+		while (text.size() < size) text += pattern;
+		unsigned int rounds = 0;
+		auto start = std::chrono::steady_clock::now();
+		double took;
+		do {
+			countingSink sink;
+			lightforums::markupParser(text.data(), text.size()).parse(sink);
+			rounds++;
+			took = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		} while (took < 1);
+		std::cout << std::left << std::setw(16) << name << std::right << std::fixed << std::setprecision(2)
+				<< std::setw(8) << took * 1e9 / rounds / text.size() << " ns/byte"
+				<< std::setw(10) << took * 1e3 / rounds << " ms each" << std::endl;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	size_t size = (argc > 1 ? atoi(argv[1]) : 1) << 20;
+	measure("plain prose", "The quick brown fox jumps over the lazy dog, and then rests for a while.\n", size);
+	measure("typical markup", "Some *bold* and _italic_ text, {a spoiler with [a link|/12/]} and `code`.\n!Heading\n", size);
+	measure("deep nesting", "_a *b -c ^d ~e~ d^ c- b* a_ ", size);
+	// The worst cases found while fuzzing, each mark starts something that never ends, these took
+	// seconds for a few kilobytes or ran out of memory before the parser was linear
+	measure("\"_a \"", "_a ", size);
+	measure("\"{\"", "{", size);
+	measure("\"!!!\"", "!!!", size);
+	measure("\"[x|\"", "[x|", size);
+	measure("\"a_b_ \"", "a_b_ ", size);
+	measure("\"_*-^~ \"", "_*-^~ ", size);
+	return 0;
+}
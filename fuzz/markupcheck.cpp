@@ -0,0 +1,75 @@
+#include "markup.h"
+#include "markupreference.h"
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// Compares what the parser makes of every text in files of texts separated by zero bytes with what
+// the old one made of it. Texts where the old one ran into a deliberate difference are counted by
+// the difference, any other text must be shown the same way, or it's written out and the check fails.
+// Usage: markupcheck texts...
+
+namespace {
+
+	std::string oneLine(const std::string& shown) {
+		std::string result;
+		for (char c : shown) {
+			if (c == '\n') result += "\\n";
+			else result.push_back(c);
+		}
+		return result;
+	}
+
+	bool check(const std::string& fileName) {
+		std::ifstream in(fileName, std::ios::binary);
+		if (!in) {
+			std::cerr << "Can't read " << fileName << std::endl;
+			return false;
+		}
+		std::string all((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		unsigned int number = 0;
+		unsigned int same = 0;
+		unsigned int different = 0;
+		unsigned int deliberate[reference::differenceSize] = {};
+		for (size_t from = 0; from < all.size(); number++) {
+			size_t end = all.find('\0', from);
+			if (end == std::string::npos) end = all.size();
+			std::string text = all.substr(from, end - from);
+			from = end + 1;
+			reference::printingSink old;
+			reference::difference met = reference::render(text, old);
+			if (met != reference::NONE) {
+				deliberate[met]++;
+				continue;
+			}
+			reference::printingSink shown;
+			lightforums::markupParser(text.data(), text.size()).parse(shown);
+			if (shown.shown == old.shown) {
+				same++;
+				continue;
+			}
+			std::cout << fileName << " " << number << ": " << oneLine(text) << "\n  old: " << oneLine(old.shown)
+					<< "\n  new: " << oneLine(shown.shown) << "\n";
+			different++;
+		}
+		std::cout << fileName << ": " << number << " texts, " << same << " the same";
+		for (unsigned int i = reference::NONE + 1; i < reference::differenceSize; i++) {
+			if (deliberate[i]) std::cout << ", " << deliberate[i] << " " << reference::describe((reference::difference)i);
+		}
+		if (different) std::cout << ", " << different << " DIFFERENT";
+		std::cout << std::endl;
+		return !different;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cerr << "Usage: markupcheck texts..." << std::endl;
+		return 1;
+	}
+	bool fine = true;
+	for (int i = 1; i < argc; i++) fine = check(argv[i]) && fine;
+	return fine ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+#include "markup.h"
+#include "markupreference.h"
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Fuzzing entry point for the markup parser, which also compares it with the old parser on shorter inputs.
+// Built with -DLIBFUZZER, libFuzzer supplies main().
+// Otherwise it replays the files given (or stdin, as AFL runs it) once each, or with -mutate, changes
+// the seeds randomly for a while, which needs no fuzzing engine at all.
+
+namespace {
+
+	struct checkingSink : public lightforums::markupSink {
+		// Checks that every piece of HTML it's given is balanced and escaped
+		size_t bytes = 0;
+		int spoilers = 0;
+
+		void check(const std::string& html) {
+			const char* tags[] = { "em", "strong", "strike", "sup", "sub", "h1", "tt" };
+			for (const char* tag : tags) {
+				std::string open = std::string("<") + tag + ">";
+				std::string close = std::string("</") + tag + ">";
+				size_t opens = 0, closes = 0;
+				for (size_t at = html.find(open); at != std::string::npos; at = html.find(open, at + 1)) opens++;
+				for (size_t at = html.find(close); at != std::string::npos; at = html.find(close, at + 1)) closes++;
+				if (opens != closes) fail("unbalanced <" + std::string(tag) + "> in " + html);
+			}
+			if (html.find('"') != std::string::npos || html.find('\'') != std::string::npos) fail("unescaped quote in " + html);
+		}
+		static void fail(const std::string& why) {
+			std::cerr << why << std::endl;
+			abort();
+		}
+
+		void addHtml(const std::string& html) override {
+			check(html);
+			bytes += html.size();
+		}
+		void addLink(const std::string& html, const char*, size_t pathSize) override {
+			check(html);
+			bytes += html.size() + pathSize;
+		}
+		void addSpoiler(bool start) override {
+			spoilers += start ? 1 : -1;
+			if (spoilers < 0) fail("spoiler closed before it was opened");
+		}
+	};
+
+	const size_t REFERENCE_LIMIT = 1 << 12; // The old parser rescans too much to keep up on longer inputs
+	unsigned long int compared = 0;
+
+	std::vector<std::string> readInputs(const std::string& path) {
+		std::vector<std::string> result;
+		struct stat info;
+		if (stat(path.c_str(), &info)) {
+			std::cerr << "Can't read " << path << std::endl;
+			return result;
+		}
+		if (S_ISDIR(info.st_mode)) {
+			DIR* dir = opendir(path.c_str());
+			if (!dir) return result;
+			while (dirent* entry = readdir(dir)) {
+				if (entry->d_name[0] == '.') continue;
+				std::vector<std::string> inside = readInputs(path + "/" + entry->d_name);
+				result.insert(result.end(), inside.begin(), inside.end());
+			}
+			closedir(dir);
+		} else {
+			std::ifstream in(path, std::ios::binary);
+			result.push_back(std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()));
+		}
+		return result;
+	}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	checkingSink sink;
+	lightforums::markupParser((const char*)data, size).parse(sink);
+	if (sink.spoilers) checkingSink::fail("spoiler not closed");
+	// Every byte of the text is shown at most once, with tags around it
+	if (sink.bytes > size * 40 + 64) checkingSink::fail("output of " + std::to_string(sink.bytes) + " bytes for " + std::to_string(size));
+
+	// The old parser stops at a zero byte, the new one doesn't
+	if (size > REFERENCE_LIMIT || memchr(data, 0, size)) return 0;
+	std::string text((const char*)data, size);
+	reference::printingSink old;
+	if (reference::render(text, old) != reference::NONE) return 0;
+	reference::printingSink shown;
+	lightforums::markupParser((const char*)data, size).parse(shown);
+	if (shown.shown != old.shown) checkingSink::fail("shown differently than before: " + text + "\nold: " + old.shown + "\nnew: " + shown.shown);
+	compared++;
+	return 0;
+}
+
+namespace {
+
+	void runOne(const std::string& text) {
+		std::vector<uint8_t> exact(text.begin(), text.end()); // Exactly sized, so that reading past the end is caught
+		LLVMFuzzerTestOneInput(exact.data(), exact.size());
+	}
+
+	void mutate(const std::vector<std::string>& seeds, int seconds, unsigned int seed) {
+		std::mt19937 random(seed);
+		const char marks[] = "_*-^~{}[]|!`\\\n \t.,;?<>&\"'";
+		auto until = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+		unsigned long int runs = 0;
+		while (std::chrono::steady_clock::now() < until) {
+			std::string text = seeds[random() % seeds.size()];
+			int edits = random() % 8 + 1;
+			for (int i = 0; i < edits; i++) {
+				size_t at = random() % (text.size() + 1);
+				switch (random() % 4) {
+					case 0:
+						text.insert(at, 1, marks[random() % (sizeof(marks) - 1)]);
+						break;
+					case 1:
+						if (at < text.size()) text.erase(at, 1);
+						break;
+					case 2: {
+						const std::string& other = seeds[random() % seeds.size()];
+						if (!other.empty()) text.insert(at, other.substr(random() % other.size(), random() % 40));
+						break;
+					}
+					default:
+						if (at < text.size()) text[at] = random() % 256;
+				}
+			}
+			runOne(text);
+			runs++;
+		}
+		std::cout << runs << " inputs without a failure, " << compared << " shown the same as by the old parser" << std::endl;
+	}
+
+}
+
+#ifndef LIBFUZZER
+int main(int argc, char** argv) {
+	// markupfuzz [files or directories]      replays them, stdin if there are none
+	// markupfuzz -mutate seconds seed corpus  changes the inputs in the corpus randomly
+	if (argc >= 5 && std::string(argv[1]) == "-mutate") {
+		std::vector<std::string> seeds;
+		for (int i = 4; i < argc; i++) {
+			std::vector<std::string> got = readInputs(argv[i]);
+			seeds.insert(seeds.end(), got.begin(), got.end());
+		}
+		if (seeds.empty()) return 1;
+		mutate(seeds, atoi(argv[2]), atoi(argv[3]));
+		return 0;
+	}
+	if (argc == 1) {
+		runOne(std::string(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>()));
+		return 0;
+	}
+	unsigned int replayed = 0;
+	for (int i = 1; i < argc; i++) {
+		std::vector<std::string> got = readInputs(argv[i]);
+		for (unsigned int j = 0; j < got.size(); j++) runOne(got[j]);
+		replayed += got.size();
+	}
+	std::cout << replayed << " inputs without a failure, " << compared << " shown the same as by the old parser" << std::endl;
+	return 0;
+}
+#endif
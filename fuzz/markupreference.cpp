@@ -0,0 +1,248 @@
+#include "markupreference.h"
+#include <vector>
+
+// The old parser is copied as it was, with the output going to a markupSink instead of widgets.
+// Where it would run into one of the deliberate differences, it stops and throws which one it was,
+// nothing it shows then matters. Most of them read past the end of the text or repeated all of it.
+
+namespace {
+
+	enum markup : unsigned int {
+		PLAIN = 0x0,
+		HEADING = 0x1,
+		SPOILER = 0x2,
+		ITALIC = 0x4,
+		BOLD = 0x8,
+		CODE = 0x10,
+		STRIKETHROUGH = 0x20,
+		SUBSCRIPT = 0x40,
+		SUPERSCRIPT = 0x80,
+		LINK = 0x100,
+	};
+
+	struct node {
+		markup style;
+		std::string text;
+		std::string path;
+		std::vector<node> deeper;
+		node(const std::string& source, markup styleOutside = PLAIN, std::string linkPath = "") : style(styleOutside) {
+			if (styleOutside == CODE) {
+				text = source;
+				return;
+			}
+			path = linkPath;
+			std::pair<char, markup> pairMarkups[] = {{'_', ITALIC}, {'*', BOLD}, {'-', STRIKETHROUGH}, {'^', SUPERSCRIPT}, {'~', SUBSCRIPT}};
+			auto getMarkup = [&] (const char character) -> markup {
+				for (int i = 0; i < 5; i++) if (character == pairMarkups[i].first) return pairMarkups[i].second;
+				return PLAIN; // PLAIN == 0 == false
+			};
+
+			std::string soFar;
+			auto pushSoFar = [&] () -> void {
+				if (soFar.empty()) return;
+				deeper.push_back(node(soFar, PLAIN));
+				soFar.clear();
+			};
+			auto increment = [&] (const char*& str) { // special decrement/increment to deal with code
+				str++;
+				if (*str == '`' && (str == source.c_str() || str[-1] != '//')) {
+					// It skipped to the matching `, but '//' is no character, so it went on to the end of the text and past it
+					throw str[-1] == '\\' ? reference::ESCAPED_CODE : reference::NESTED_CODE;
+				}
+			};
+			auto decrement = [&] (const char*& str) {
+				if (str > source.c_str()) str--;
+				if (*str == '`' && str[-1] != '\\') {
+					throw reference::NESTED_CODE; // The same going back, to before the start of the text
+				}
+			};
+
+			for (const char* str = source.c_str(); *str; str++) {
+				if ((str == source.c_str() || str[-1] == '\n') && *str == '!') {
+					pushSoFar();
+					const char* strIn = str + 1;
+					for ( ; *strIn && (*strIn != '\n' || strIn[-1] == '\\'); increment(strIn)) {
+						soFar.push_back(*strIn);
+					}
+					if (!*strIn) throw reference::HEADING_AT_END;
+					deeper.push_back(node(soFar, HEADING, path));
+					soFar.clear();
+					str = strIn;
+				} else if ((str == source.c_str() || str[-1] != '\\') && *str == '{') {
+					pushSoFar();
+					const char* strIn = str + 1;
+					int depth = 0;
+					for ( ; *strIn; increment(strIn)) {
+						if (*strIn == '{' && strIn[-1] != '\\') depth++;
+						if (*strIn == '}' && strIn[-1] != '\\') {
+							if (!depth) break;
+							else depth--;
+						}
+						soFar.push_back(*strIn);
+					}
+					if (!*strIn) throw reference::UNTERMINATED;
+					deeper.push_back(node(soFar, SPOILER, path));
+					soFar.clear();
+					str = strIn;
+				}
+				else if ((str == source.c_str() || str[-1] != '\\') && *str == '[') {
+					pushSoFar();
+					const char* strIn = str + 1;
+					int depth = 0;
+					for ( ; *strIn; increment(strIn)) {
+						if (*strIn == '[' && strIn[-1] != '\\') depth++;
+						if (*strIn == '|' && strIn[-1] != '\\') {
+							if (!depth) break;
+							else depth--;
+						}
+						soFar.push_back(*strIn);
+					}
+					if (!*strIn) throw reference::UNTERMINATED;
+					str = strIn + 1;
+					std::string foundPath;
+					for ( ; *str && *str != ']'; str++) foundPath.push_back(*str);
+					if (!*str) throw reference::UNTERMINATED; // Went on past the end of the text
+					deeper.push_back(node(soFar, LINK, foundPath));
+					soFar.clear();
+				} else {
+					if (str == source.c_str() || str[-1] == ' ' || str[-1] == '\t' || str[-1] == '\n') {
+						markup got = getMarkup(*str);
+						if (got) {
+							bool isMarkup = false;
+							for (const char* innerIt = str + 1; *innerIt != ' ' && *innerIt != '\t' && *innerIt != '\n'; increment(innerIt)) {
+								if (!getMarkup(*innerIt)) {
+									isMarkup = true;
+									break;
+								}
+							}
+							if (isMarkup) {
+								bool ended = false;
+								for (const char* innerIt = str; *innerIt; increment(innerIt)) {
+									// Looked before the start of the text if the mark was its first character
+									if (*innerIt == *str && (innerIt[1] == ' ' || innerIt[1] == '\t' || innerIt[1] == '\n' || innerIt[1] == '.' || innerIt[1] == ','
+															 || innerIt[1] == ';' || innerIt[1] == '?' || innerIt[1] == '!' || innerIt[1] == 0)
+															 && (innerIt == source.c_str() || innerIt[-1] != '\\')) {
+										isMarkup = false;
+										for (const char* innerInnerIt = innerIt; innerInnerIt > str; decrement(innerInnerIt)) {
+											if (*innerIt == ' ' || *innerIt == '\n' || *innerIt == '\t') break;
+											else if (!getMarkup(*innerInnerIt)) {
+												isMarkup = true;
+												break;
+											}
+										}
+										if (isMarkup) {
+											std::string added;
+											for ( str++ ; str != innerIt; increment(str)) added.push_back(*str);
+											pushSoFar();
+											deeper.push_back(node(added, got));
+											ended = true;
+											break;
+										} else throw reference::REPEATED_MARK;
+									}
+								}
+								if (!ended) throw reference::UNTERMINATED; // The mark was dropped
+								continue;
+							}
+						}
+					}
+					if (*str == '`' && (str == source.c_str() || str[-1] != '\\')) {
+						str++;
+						std::string added;
+						for ( ; *str != '`'; str++) {
+							if (!*str) throw reference::UNTERMINATED; // Went on past the end of the text
+							added.push_back(*str);
+						}
+						pushSoFar();
+						deeper.push_back(node(added, CODE));
+					} else soFar.push_back(*str);
+				}
+			}
+
+			if (deeper.empty()) text.swap(soFar);
+			else pushSoFar();
+			if (styleOutside == LINK && !deeper.empty()) throw reference::STYLED_LINK; // Its parts had no path
+		}
+		void chew() {
+			if (text.empty()) {
+				for (unsigned int i = 0; i < deeper.size(); i++) deeper[i].chew();
+			} else {
+				std::string newText;
+				for (const char* str = text.c_str(); *str; str++) {
+					if (*str == '\n') {
+						newText.append("<br/>");
+					} else if (*str == '\\' && str[1] == '\\') {
+						newText.push_back('\\');
+						str++;
+					} else if (*str == ' ' && str[1] == ' ') {
+						newText.append("&nbsp;");
+						str++;
+					} else if (*str == '<') {
+						newText.append("&lt;");
+					} else if (*str == '>') {
+						newText.append("&gt;");
+					} else if (*str == '&') {
+						newText.append("&#38;");
+					} else if (*str == '"') {
+						newText.append("&#34;");
+					} else if (*str == '\'') {
+						newText.append("&#39;");
+					} else if (*str == '\\' && (str[1] == '_' || str[1] == '*' || str[1] == '-' || str[1] == '~' || str[1] == '-' || str[1] == '`' || str[1] == '!' || str[1] == '{' || str[1] == '}' || str[1] == ']' || str[1] == '|')) {}
+					else newText.push_back(*str);
+				}
+				text.swap(newText);
+			}
+		}
+
+		void construct(lightforums::markupSink& into, unsigned int flags = 0x0) {
+			if (deeper.empty()) {
+				std::string prefix;
+				std::string suffix;
+				if (flags & CODE) { prefix += "<tt>"; suffix = "</tt>" + suffix; }
+				if (flags & ITALIC) { prefix += "<em>"; suffix = "</em>" + suffix; }
+				if (flags & BOLD) { prefix += "<strong>"; suffix = "</strong>"  + suffix; }
+				if (flags & STRIKETHROUGH) { prefix += "<strike>"; suffix = "</strike>" + suffix; }
+				if (flags & SUPERSCRIPT) { prefix += "<sup>"; suffix = "</sup>" + suffix; }
+				if (flags & SUBSCRIPT) { prefix += "<sub>"; suffix = "</sub>" + suffix; }
+				if (flags & HEADING) { prefix += "<h1>"; suffix = "</h1>" + suffix; }
+				if (flags & LINK) {
+					into.addLink(prefix + text + suffix, path.data(), path.size());
+				} else into.addHtml(prefix + text + suffix);
+			} else {
+				for (unsigned int i = 0; i < deeper.size(); i++) {
+					if (deeper[i].style == PLAIN) deeper[i].construct(into, flags); // Most common, let it be dealt with easily
+					else if (deeper[i].style == SPOILER) {
+						into.addSpoiler(true);
+						deeper[i].construct(into, flags);
+						into.addSpoiler(false);
+					} else {
+						deeper[i].construct(into, flags ^ deeper[i].style);
+					}
+				}
+			}
+		}
+	};
+
+}
+
+const char* reference::describe(difference which) {
+	switch (which) {
+		case UNTERMINATED: return "unterminated";
+		case HEADING_AT_END: return "heading at the end";
+		case NESTED_CODE: return "nested code";
+		case STYLED_LINK: return "styled link";
+		case ESCAPED_CODE: return "escaped code";
+		case REPEATED_MARK: return "repeated mark";
+		default: return "none";
+	}
+}
+
+reference::difference reference::render(const std::string& text, lightforums::markupSink& into) {
+	try {
+		node parsed(text);
+		parsed.chew();
+		parsed.construct(into);
+	} catch (difference met) {
+		return met;
+	}
+	return NONE;
+}
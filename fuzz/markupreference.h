@@ -0,0 +1,40 @@
+#ifndef MARKUPREFERENCE_H
+#define MARKUPREFERENCE_H
+
+#include <string>
+#include "markup.h"
+
+// The parser formatString used before markupParser, kept as it was to compare the new one with.
+// It rescans and copies the text for every construct it meets, so it's slow on long texts.
+
+namespace reference {
+
+	enum difference {
+		// Where the new parser differs on purpose, the old one tells which of these it ran into,
+		// anything else must be shown the same way
+		NONE,
+		UNTERMINATED, // { [ ` or a style mark without its end, dropped or repeating the rest, now shown as typed
+		HEADING_AT_END, // ! on a line with no line break after it repeated the line, now it's a heading
+		NESTED_CODE, // `code` inside other constructs made it read past the end of the text, now it's kept as it is
+		ESCAPED_CODE, // \` inside other constructs still started code the same way, now it never does
+		STYLED_LINK, // A link with anything inside its caption lost its path, now it keeps it
+		REPEATED_MARK, // An end of a style with only marks since its start added the start mark once more
+		differenceSize
+	};
+	const char* describe(difference which);
+
+	difference render(const std::string& text, lightforums::markupSink& into); // What's shown is incomplete if it's not NONE
+
+	struct printingSink : public lightforums::markupSink {
+		// All that's shown as a single string, which is what's compared
+		std::string shown;
+		void addHtml(const std::string& html) override { shown += html; }
+		void addLink(const std::string& html, const char* path, size_t pathSize) override {
+			shown += "<a href=\"" + std::string(path, pathSize) + "\">" + html + "</a>";
+		}
+		void addSpoiler(bool start) override { shown += start ? "<details>" : "</details>"; }
+	};
+
+}
+
+#endif // MARKUPREFERENCE_H
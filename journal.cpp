@@ -0,0 +1,569 @@
+#include "journal.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include "binarystream.h"
+#include "mainwindow.h"
+#include "userlist.h"
+#include "settings.h"
+#include "postindex.h"
+#include "activity.h"
+#include "rendercache.h"
+
+#define JOURNAL_CHECKSUM_SEED 7919
+
+lightforums::journal::journal() :
+	queue_(4096),
+	running_(false),
+	sleeping_(false),
+	written_(0),
+	stopped_(true),
+	file_(-1),
+	records_(0),
+	bytes_(0),
+	batches_(0),
+	syncs_(0),
+	largestBatch_(0),
+	durableCommits_(0),
+	commitLatencyTotal_(0),
+	commitLatencyMax_(0)
+{
+}
+
+lightforums::journal::~journal() {
+	close();
+}
+
+void lightforums::journal::open(const std::string& fileName) {
+	close();
+	{
+		std::lock_guard<std::mutex> guard(fileLock_);
+		fileName_ = fileName;
+		file_ = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (file_ < 0) {
+			std::cerr << "Could not open journal " << fileName << ", changes will be saved only occasionally" << std::endl;
+			return;
+		}
+	}
+	{
+		std::lock_guard<std::mutex> guard(writtenLock_);
+		stopped_ = false;
+	}
+	running_ = true;
+	writer_ = std::thread([this] () { writeLoop(); });
+}
+
+void lightforums::journal::close() {
+	if (running_.exchange(false)) {
+		{
+			std::lock_guard<std::mutex> guard(wakeLock_);
+			wake_.notify_one();
+		}
+		writer_.join(); // It writes everything queued before leaving
+		std::lock_guard<std::mutex> guard(writtenLock_);
+		stopped_ = true; // Anything queued after it left won't be written
+		writtenChanged_.notify_all();
+	}
+	std::lock_guard<std::mutex> guard(fileLock_);
+	if (file_ >= 0) ::close(file_);
+	file_ = -1;
+}
+
+void lightforums::journal::rotate() {
+	std::lock_guard<std::mutex> guard(fileLock_);
+	if (file_ < 0) return;
+	::close(file_);
+	// Records written before this point will be in the save that is about to be made
+	std::string old = fileName_ + ".old";
+	std::ifstream previous(old, std::ios::binary);
+	if (previous.is_open()) {
+		// The last save failed and its records are still needed, these go after them
+		previous.close();
+		std::ifstream current(fileName_, std::ios::binary);
+		std::ofstream appended(old, std::ios::binary | std::ios::app);
+		appended << current.rdbuf();
+		appended.close();
+		if (appended.good()) std::remove(fileName_.c_str());
+	} else std::rename(fileName_.c_str(), old.c_str());
+	file_ = ::open(fileName_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+void lightforums::journal::dropRotated() {
+	std::lock_guard<std::mutex> guard(fileLock_);
+	if (fileName_.empty()) return;
+	std::remove((fileName_ + ".old").c_str());
+}
+
+bool lightforums::journal::append(const binaryWriter& record, commitPolicy policy) {
+	if (!running_) return policy != WAIT_FOR_DURABLE; // Not opened yet, probably replaying
+	bool failed = false;
+	pendingRecord pending;
+	binaryWriter frame;
+	frame.putVarint(record.size());
+	frame.putFixed32(murmur(record.data().c_str(), record.size(), JOURNAL_CHECKSUM_SEED));
+	frame.putRaw(record.data().c_str(), record.size());
+	pending.frame = frame.data();
+	pending.durable = (policy == WAIT_FOR_DURABLE);
+	pending.failed = pending.durable ? &failed : nullptr; // Set by the writer, it's done with it before this returns
+	pending.queuedAt = std::chrono::steady_clock::now();
+	uint_fast64_t ticket = queue_.push(std::move(pending));
+	if (sleeping_) {
+		std::lock_guard<std::mutex> guard(wakeLock_);
+		wake_.notify_one();
+	}
+	if (policy == WAIT_FOR_DURABLE) {
+		std::unique_lock<std::mutex> lock(writtenLock_);
+		writtenChanged_.wait(lock, [&] () { return written_ > ticket || stopped_; });
+		return written_ > ticket && !failed;
+	}
+	return true;
+}
+
+bool lightforums::journal::writeBatch(const std::string& batch, bool sync) {
+	std::lock_guard<std::mutex> guard(fileLock_);
+	if (file_ < 0) return false;
+	off_t start = lseek(file_, 0, SEEK_END); // Where a failed batch is cut off
+	const char* pos = batch.c_str();
+	size_t left = batch.size();
+	while (left > 0) {
+		ssize_t done = ::write(file_, pos, left);
+		if (done < 0) {
+			if (errno == EINTR) continue;
+			std::cerr << "Could not write to journal " << fileName_ << ": " << strerror(errno) << std::endl;
+			cutOff(start);
+			return false;
+		}
+		pos += done;
+		left -= done;
+	}
+	if (sync) {
+#ifdef __linux__
+		int synced = fdatasync(file_);
+#else
+		int synced = fsync(file_);
+#endif
+		syncs_++;
+		if (synced) {
+			std::cerr << "Could not sync journal " << fileName_ << ": " << strerror(errno) << std::endl;
+			cutOff(start);
+			return false;
+		}
+	}
+	return true;
+}
+
+void lightforums::journal::cutOff(off_t from) {
+	// A torn frame would stop the replay there, so the records written after it would be lost too
+	if (from >= 0 && !ftruncate(file_, from)) return;
+	std::cerr << "Could not remove a failed write from journal " << fileName_ << ", nothing more is written into it" << std::endl;
+	::close(file_);
+	file_ = -1;
+}
+
+void lightforums::journal::writeLoop() {
+	std::string batch;
+	std::vector<std::chrono::steady_clock::time_point> durableQueuedAt;
+	std::vector<bool*> failedFlags;
+	pendingRecord got;
+	while (true) {
+		if (!queue_.try_pop(got)) {
+			if (!running_) break;
+			std::unique_lock<std::mutex> lock(wakeLock_);
+			sleeping_ = true;
+			if (queue_.size() == 0 && running_) wake_.wait_for(lock, std::chrono::milliseconds(10));
+			sleeping_ = false;
+			continue;
+		}
+
+		// Gather everything that's queued, if someone waits for a sync, also what comes during the batch window
+		batch.clear();
+		durableQueuedAt.clear();
+		failedFlags.clear();
+		uint64_t count = 0;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(Settings::get().durableWindow);
+		bool gathering = true;
+		while (gathering) {
+			batch.append(got.frame);
+			if (got.durable) {
+				durableQueuedAt.push_back(got.queuedAt);
+				failedFlags.push_back(got.failed);
+			}
+			count++;
+			while (!queue_.try_pop(got)) {
+				if (durableQueuedAt.empty() || !running_ || std::chrono::steady_clock::now() >= deadline) {
+					gathering = false;
+					break;
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(20));
+			}
+		}
+
+		bool fine = writeBatch(batch, !durableQueuedAt.empty());
+		{
+			std::lock_guard<std::mutex> guard(writtenLock_);
+			if (!fine) for (unsigned int i = 0; i < failedFlags.size(); i++) *failedFlags[i] = true;
+			written_ += count;
+			writtenChanged_.notify_all();
+		}
+
+		records_ += count;
+		bytes_ += batch.size();
+		batches_++;
+		uint_fast64_t largest = largestBatch_;
+		while (count > largest && !largestBatch_.compare_exchange_weak(largest, count)) { }
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < durableQueuedAt.size(); i++) {
+			uint_fast64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(now - durableQueuedAt[i]).count();
+			durableCommits_++;
+			commitLatencyTotal_ += latency;
+			uint_fast64_t longest = commitLatencyMax_;
+			while (latency > longest && !commitLatencyMax_.compare_exchange_weak(longest, latency)) { }
+		}
+	}
+}
+
+lightforums::journal::statistics lightforums::journal::getStatistics() const {
+	statistics result;
+	result.records = records_;
+	result.bytes = bytes_;
+	result.batches = batches_;
+	result.syncs = syncs_;
+	result.largestBatch = largestBatch_;
+	result.durableCommits = durableCommits_;
+	result.commitLatencyTotal = commitLatencyTotal_;
+	result.commitLatencyMax = commitLatencyMax_;
+	return result;
+}
+
+std::string lightforums::journal::describeStatistics() const {
+	statistics got = getStatistics();
+	std::string result = "Journal: " + std::to_string(got.records) + " records (" + std::to_string(got.bytes) + " bytes) in "
+			+ std::to_string(got.batches) + " batches, largest " + std::to_string(got.largestBatch) + ", " + std::to_string(got.syncs) + " syncs";
+	if (got.batches) result += ", " + std::to_string(got.records / (double)got.batches) + " records per batch";
+	if (got.durableCommits) result += ", durable commit latency " + std::to_string(got.commitLatencyTotal / got.durableCommits)
+			+ " us on average, " + std::to_string(got.commitLatencyMax) + " us at most";
+	return result;
+}
+
+namespace lightforums {
+
+	static void writePost(binaryWriter& writer, std::shared_ptr<post> written) {
+		writer.putString(postPath(written).getString());
+		std::shared_ptr<postText> title = std::atomic_load(&written->title_);
+		writer.putString(title->data(), title->size());
+		writer.putString(*std::atomic_load(&written->author_));
+		std::shared_ptr<postText> text = std::atomic_load(&written->text_);
+		writer.putString(text->data(), text->size());
+		writer.putByte(written->visibility_);
+		writer.putVarint(written->depth_);
+		writer.putByte(written->sortBy_);
+		writer.putVarint(written->postedAt_);
+		std::shared_ptr<std::string> pin = std::atomic_load(&written->pin_);
+		writer.putByte(pin ? 1 : 0);
+		if (pin) writer.putString(*pin);
+		std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files = std::atomic_load(&written->files_);
+		writer.putVarint(files ? files->size() : 0);
+		if (files) for (unsigned int i = 0; i < files->size(); i++) {
+			writer.putVarint(files->operator [](i).first);
+			writer.putString(files->operator [](i).second);
+		}
+		writer.putVarint(written->getUid());
+	}
+
+	struct journalledPost {
+		std::string path;
+		uint64_t uid;
+		std::string title;
+		std::string author;
+		std::string text;
+		rank visibility;
+		unsigned int depth;
+		sortPosts sortBy;
+		time_t postedAt;
+		std::shared_ptr<std::string> pin;
+		std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files;
+
+		journalledPost(binaryReader& reader) {
+			path = reader.getString();
+			title = reader.getString();
+			author = reader.getString();
+			text = reader.getString();
+			visibility = (rank)reader.getByte();
+			depth = reader.getVarint();
+			sortBy = (sortPosts)reader.getByte();
+			postedAt = reader.getVarint();
+			if (reader.getByte()) pin = std::make_shared<std::string>(reader.getString());
+			unsigned int fileCount = reader.getVarint();
+			if (fileCount && !reader.failed()) {
+				files = std::make_shared<std::vector<std::pair<unsigned int, std::string>>>();
+				for (unsigned int i = 0; i < fileCount && !reader.failed(); i++) {
+					unsigned int systemName = reader.getVarint();
+					files->push_back(std::make_pair(systemName, reader.getString()));
+				}
+			}
+			uid = reader.atEnd() ? 0 : reader.getVarint(); // Not in records written before global ids
+			if (visibility >= rankSize) visibility = USER;
+			if (sortBy >= sortPostsSize) sortBy = SORT_SOMEHOW;
+		}
+
+		void applyEditable(std::shared_ptr<post> target) {
+			std::atomic_store(&target->title_, std::make_shared<postText>(title));
+			std::atomic_store(&target->author_, std::make_shared<std::string>(author));
+			std::atomic_store(&target->text_, renderCache::get().compiled(std::make_shared<postText>(text)));
+			target->sortBy_ = sortBy;
+			std::atomic_store(&target->pin_, pin);
+			target->orderChanged();
+			std::atomic_store(&target->files_, files);
+			if (files) for (unsigned int i = 0; i < files->size(); i++) {
+				// Files uploaded after the last save must not be overwritten by later uploads
+				unsigned int order = Settings::get().fileOrder;
+				while (order <= files->operator [](i).first && !Settings::get().fileOrder.compare_exchange_weak(order, files->operator [](i).first + 1)) { }
+			}
+		}
+	};
+
+	static std::shared_ptr<post> findPost(const postPath& path, uint64_t uid) {
+		if (uid) return postIndex::get().find(uid);
+		// Unlike mainWindow::getPost, it doesn't settle for the closest existing ancestor
+		return root::get().getRootPost()->find(path);
+	}
+
+	static std::shared_ptr<post> findParent(const std::string& path, unsigned int& id) {
+		std::vector<std::string> parts = splitString(path, '/');
+		if (parts.size() < 2) return nullptr; // The root is never created or deleted
+		// A damaged record must not stop the replay, so it's checked rather than thrown at
+		const char* digits = parts.back().c_str();
+		char* end = nullptr;
+		errno = 0;
+		unsigned long got = strtoul(digits, &end, 10);
+		if (*digits < '0' || *digits > '9' || *end || errno || got > UINT_MAX) return nullptr;
+		id = got;
+		parts.pop_back();
+		std::string parentPath;
+		for (unsigned int i = 0; i < parts.size(); i++) parentPath += parts[i] + "/";
+		return findPost(postPath(parentPath), 0);
+	}
+}
+
+bool lightforums::journal::postCreated(std::shared_ptr<post> made, commitPolicy policy) {
+	binaryWriter writer;
+	writer.putByte(POST_CREATED);
+	writePost(writer, made);
+	return append(writer, policy);
+}
+
+void lightforums::journal::postEdited(std::shared_ptr<post> edited) {
+	binaryWriter writer;
+	writer.putByte(POST_EDITED);
+	writePost(writer, edited);
+	append(writer);
+}
+
+void lightforums::journal::postDeleted(std::shared_ptr<post> deleted) {
+	binaryWriter writer;
+	writer.putByte(POST_DELETED);
+	writer.putString(postPath(deleted).getString());
+	writer.putVarint(deleted->getUid());
+	append(writer);
+}
+
+void lightforums::journal::postRated(const std::string& userName, std::shared_ptr<post> rated, rating rate) {
+	binaryWriter writer;
+	writer.putByte(POST_RATED);
+	writer.putString(userName);
+	writer.putString(postPath(rated).getString());
+	writer.putByte(rate);
+	writer.putVarint(rated->getUid());
+	append(writer);
+}
+
+void lightforums::journal::writeUser(recordType type, std::shared_ptr<user> written) {
+	binaryWriter writer;
+	writer.putByte(type);
+	writer.putString(*std::atomic_load(&written->name_));
+	writer.putString(*std::atomic_load(&written->password_));
+	writer.putString(*std::atomic_load(&written->salt_));
+	writer.putByte(written->rank_);
+	writer.putString(written->getTitle());
+	std::shared_ptr<std::string> description = std::atomic_load(&written->description_);
+	writer.putString(description ? *description : "");
+	append(writer);
+}
+
+void lightforums::journal::userRenamed(const std::string& oldName, const std::string& newName) {
+	binaryWriter writer;
+	writer.putByte(USER_RENAMED);
+	writer.putString(oldName);
+	writer.putString(newName);
+	append(writer);
+}
+
+void lightforums::journal::cookieAdded(const std::string& token, const std::string& userName) {
+	binaryWriter writer;
+	writer.putByte(COOKIE_ADDED);
+	writer.putString(token);
+	writer.putString(userName);
+	append(writer);
+}
+
+void lightforums::journal::cookieRemoved(const std::string& token) {
+	binaryWriter writer;
+	writer.putByte(COOKIE_REMOVED);
+	writer.putString(token);
+	append(writer);
+}
+
+void lightforums::journal::settingChanged(const std::string& field) {
+	binaryWriter writer;
+	writer.putByte(SETTING_CHANGED);
+	writer.putString(field);
+	writer.putString(Settings::get().getField(field));
+	append(writer);
+}
+
+bool lightforums::journal::applyRecord(const char* data, size_t size) {
+	binaryReader reader(data, size);
+	recordType type = (recordType)reader.getByte();
+	switch (type) {
+		case POST_CREATED: {
+			journalledPost got(reader);
+			if (reader.failed()) return false;
+			unsigned int id;
+			std::shared_ptr<post> parent = findParent(got.path, id);
+			if (!parent || parent->children_.find(id) != parent->children_.end()) return false; // Parent deleted or already saved, placeAt decides
+			post* made = new post();
+			made->uid_ = got.uid ? got.uid : postIndex::get().allocate();
+			got.applyEditable(made->self());
+			made->visibility_ = got.visibility;
+			made->depth_ = got.depth;
+			made->postedAt_ = got.postedAt;
+			made->lastActivity_.store(got.postedAt);
+			if (!made->placeAt(parent, id)) {
+				made->discard(); // Placed meanwhile, it's not indexed yet
+				return false;
+			}
+			activityPropagator::get().touched(parent, got.postedAt);
+			made->markDirty(); // Not in the save's thread files yet
+			return true;
+		}
+		case POST_EDITED: {
+			journalledPost got(reader);
+			if (reader.failed()) return false;
+			std::shared_ptr<post> edited = findPost(postPath(got.path), got.uid);
+			if (!edited) return false;
+			got.applyEditable(edited);
+			edited->markDirty();
+			return true;
+		}
+		case POST_DELETED: {
+			std::string path = reader.getString();
+			uint64_t uid = reader.atEnd() ? 0 : reader.getVarint();
+			if (reader.failed()) return false;
+			std::shared_ptr<post> deleted = findPost(postPath(path), uid);
+			if (!deleted || deleted->getParent() == deleted) return false; // The root is never deleted
+			std::shared_ptr<post> parent = deleted->getParent();
+			parent->markDirty();
+			parent->children_.erase(deleted->getId());
+			parent->order_.removed(deleted->getId());
+			postIndex::get().remove(deleted);
+			return true;
+		}
+		case POST_RATED: {
+			std::string userName = reader.getString();
+			postPath path(reader.getString());
+			rating rate = (rating)reader.getByte();
+			uint64_t uid = reader.atEnd() ? 0 : reader.getVarint();
+			if (reader.failed()) return false;
+			std::shared_ptr<user> rater = userList::get().getUser(userName);
+			std::shared_ptr<post> rated = findPost(path, uid);
+			if (!rater || !rated) return false;
+			// Counts are computed after replaying, only the user's choice is restored
+			auto found = rater->ratings_.find(rated->getUid());
+			if (rate >= ratingSize) rater->ratings_.erase(rated->getUid());
+			else if (found != rater->ratings_.end()) found->second = rate;
+			else rater->ratings_.insert(rated->getUid(), rate);
+			return true;
+		}
+		case USER_ADDED:
+		case USER_CHANGED: {
+			std::string name = reader.getString();
+			std::string password = reader.getString();
+			std::string salt = reader.getString();
+			rank userRank = (rank)reader.getByte();
+			std::string title = reader.getString();
+			std::string description = reader.getString();
+			if (reader.failed()) return false;
+			std::shared_ptr<user> changed = userList::get().getUser(name);
+			bool isNew = !changed;
+			if (isNew) {
+				changed = std::make_shared<user>();
+				changed->name_ = std::make_shared<std::string>(name);
+			}
+			std::atomic_store(&changed->password_, std::make_shared<std::string>(password));
+			std::atomic_store(&changed->salt_, std::make_shared<std::string>(salt));
+			changed->rank_ = (userRank < rankSize) ? userRank : USER;
+			if (!title.empty()) changed->setTitle(title);
+			std::atomic_store(&changed->description_, std::make_shared<std::string>(description));
+			if (isNew) return userList::get().addUser(changed);
+			return true;
+		}
+		case USER_RENAMED: {
+			std::string oldName = reader.getString();
+			std::string newName = reader.getString();
+			if (reader.failed()) return false;
+			std::shared_ptr<user> renamed = userList::get().getUser(oldName);
+			if (!renamed) return false;
+			return userList::get().renameUser(renamed, newName);
+		}
+		case COOKIE_ADDED: {
+			std::string token = reader.getString();
+			std::string userName = reader.getString();
+			if (reader.failed()) return false;
+			root::get().cookies_.insert(token, userName);
+			return true;
+		}
+		case COOKIE_REMOVED: {
+			std::string token = reader.getString();
+			if (reader.failed()) return false;
+			root::get().cookies_.erase(token);
+			return true;
+		}
+		case SETTING_CHANGED: {
+			std::string field = reader.getString();
+			std::string value = reader.getString();
+			if (reader.failed()) return false;
+			Settings::get().setField(field, value);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+unsigned int lightforums::journal::replay(const std::string& fileName) {
+	std::ifstream in(fileName, std::ios::binary);
+	if (!in.is_open()) return 0;
+	std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	binaryReader reader(source.c_str(), source.size());
+	unsigned int applied = 0;
+	unsigned int total = 0;
+	while (!reader.atEnd()) {
+		size_t size = reader.getVarint();
+		uint32_t checksum = reader.getFixed32();
+		const char* record = reader.getRaw(size);
+		if (reader.failed() || murmur(record, size, JOURNAL_CHECKSUM_SEED) != checksum) {
+			std::cerr << "Journal " << fileName << " ends with an incomplete record, ignoring it" << std::endl;
+			break;
+		}
+		total++;
+		if (applyRecord(record, size)) applied++;
+	}
+	std::cerr << "Replayed " << applied << " of " << total << " records from " << fileName << std::endl;
+	return applied;
+}
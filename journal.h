@@ -0,0 +1,132 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <sys/types.h>
+#include "defines.h"
+#include "post.h"
+#include "atomic_queue.h"
+
+namespace lightforums {
+
+	class user;
+	class binaryWriter;
+
+	class journal {
+		// Append-only log of changes made since the last full save, replayed on startup after loading the save.
+		// Every record is framed as [varint length][murmur checksum][payload], a torn tail after a crash is ignored.
+		// Replaying a record that is already contained in the save must not break anything.
+		// Records are queued and written by a dedicated thread, records that need to be durable are gathered
+		// for a short while and written with a single sync.
+	public:
+		static inline journal& get() {
+			static journal holder;
+			return holder;
+		}
+
+		enum recordType : unsigned char {
+			POST_CREATED,
+			POST_EDITED,
+			POST_DELETED,
+			POST_RATED,
+			USER_ADDED,
+			USER_RENAMED,
+			USER_CHANGED,
+			COOKIE_ADDED,
+			COOKIE_REMOVED,
+			SETTING_CHANGED,
+			recordTypeSize
+		};
+
+		enum commitPolicy : unsigned char {
+			FIRE_AND_FORGET, // Returns immediately, the record is written with the next batch
+			WAIT_FOR_DURABLE, // Returns once the record is synced to the disk, with false if it couldn't be
+		};
+
+		struct statistics {
+			uint64_t records;
+			uint64_t bytes;
+			uint64_t batches;
+			uint64_t syncs;
+			uint64_t largestBatch;
+			uint64_t durableCommits;
+			uint64_t commitLatencyTotal; // In microseconds, measured only for durable commits
+			uint64_t commitLatencyMax;
+		};
+
+		void open(const std::string& fileName);
+		void close();
+		unsigned int replay(const std::string& fileName);
+		unsigned int replayAll(const std::string& fileName) { return replay(fileName + ".old") + replay(fileName); }
+		// Call rotate() before starting a full save and dropRotated() after it was written
+		void rotate();
+		void dropRotated();
+
+		statistics getStatistics() const;
+		std::string describeStatistics() const;
+
+		bool postCreated(std::shared_ptr<post> made, commitPolicy policy = FIRE_AND_FORGET); // See commitPolicy
+		void postEdited(std::shared_ptr<post> edited);
+		void postDeleted(std::shared_ptr<post> deleted);
+		void postRated(const std::string& userName, std::shared_ptr<post> rated, rating rate);
+		void userAdded(std::shared_ptr<user> added) { writeUser(USER_ADDED, added); }
+		void userRenamed(const std::string& oldName, const std::string& newName);
+		void userChanged(std::shared_ptr<user> changed) { writeUser(USER_CHANGED, changed); }
+		void cookieAdded(const std::string& token, const std::string& userName);
+		void cookieRemoved(const std::string& token);
+		void settingChanged(const std::string& field);
+
+	private:
+		journal();
+		~journal();
+
+		struct pendingRecord {
+			std::string frame;
+			bool durable;
+			bool* failed; // Of the waiting thread, if it's durable
+			std::chrono::steady_clock::time_point queuedAt;
+		};
+
+		bool append(const binaryWriter& record, commitPolicy policy = FIRE_AND_FORGET);
+		void writeUser(recordType type, std::shared_ptr<user> written);
+		bool applyRecord(const char* data, size_t size);
+		void writeLoop();
+		bool writeBatch(const std::string& batch, bool sync);
+		void cutOff(off_t from); // Call with fileLock_ held
+
+		atomic_queue<pendingRecord> queue_;
+		std::thread writer_;
+		std::atomic_bool running_;
+		std::atomic_bool sleeping_;
+		std::mutex wakeLock_;
+		std::condition_variable wake_;
+		std::atomic_uint_fast64_t written_; // Records that went through the writer, compared with tickets from the queue
+		std::mutex writtenLock_;
+		std::condition_variable writtenChanged_;
+		bool stopped_; // The writer left, guarded by writtenLock_
+
+		std::mutex fileLock_;
+		int file_;
+		std::string fileName_;
+
+		std::atomic_uint_fast64_t records_;
+		std::atomic_uint_fast64_t bytes_;
+		std::atomic_uint_fast64_t batches_;
+		std::atomic_uint_fast64_t syncs_;
+		std::atomic_uint_fast64_t largestBatch_;
+		std::atomic_uint_fast64_t durableCommits_;
+		std::atomic_uint_fast64_t commitLatencyTotal_;
+		std::atomic_uint_fast64_t commitLatencyMax_;
+
+		journal(const journal&) = delete;
+		void operator=(const journal&) = delete;
+	};
+
+}
+
+#endif // JOURNAL_H
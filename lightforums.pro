@@ -11,7 +11,20 @@ SOURCES += main.cpp \
     userlist.cpp \
     settings.cpp \
     translation.cpp \
-	defines.cpp
+	defines.cpp \
+	journal.cpp \
+	snapshot.cpp \
+	mappedfile.cpp \
+	xmlwriter.cpp \
+	epoch.cpp \
+	atomicfile.cpp \
+	postindex.cpp \
+	childorder.cpp \
+	activity.cpp \
+	rendercache.cpp \
+	markup.cpp \
+	escape.cpp \
+	preview.cpp
 unix: LIBS += -lwt -lwthttp
 
 INCLUDEPATH += /usr/include/Wt
@@ -27,4 +40,18 @@ HEADERS += \
     atomic_vector.h \
     atomic_queue.h \
     settings.h \
-	translation.h
+	translation.h \
+	binarystream.h \
+	journal.h \
+	snapshot.h \
+	mappedfile.h \
+	xmlwriter.h \
+	epoch.h \
+	atomicfile.h \
+	postindex.h \
+	childorder.h \
+	activity.h \
+	rendercache.h \
+	markup.h \
+	escape.h \
+	preview.h
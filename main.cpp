@@ -2,12 +2,26 @@
 #include <fstream>
 #include "mainwindow.h"
 #include "rapidxml.hpp"
-#include "rapidxml_print.hpp"
 #include <thread>
 #include <chrono>
+#include <sys/stat.h>
 #include "settings.h"
 #include "post.h"
 #include "userlist.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "xmlwriter.h"
+#include "atomicfile.h"
+#include "postindex.h"
+#include "activity.h"
+#include "rendercache.h"
+
+#define SAVE_FILE "saved_data.xml"
+#define BINARY_SAVE_FILE "saved_data.bin"
+#define BACKUP_FILE "backup_data.xml"
+#define JOURNAL_FILE "saved_data.journal"
+#define LOCALES_DIRECTORY "locales"
+#define USERS_PER_TASK 1000
 
 volatile bool exiting = false;
 volatile bool readyToExit = false;
@@ -68,29 +82,74 @@ void segfaultHandler(int sig, siginfo_t* info, void* secret) {
 
 #endif
 
-void setupStructures(const std::string& fileName) {
+bool loadStructures(const std::string& fileName) {
 	std::ifstream in(fileName);
 	if (in.is_open()) {
 		std::cerr << "Could open file\n";
 		std::string source((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		lightforums::atomicFile::checksumState checksum = lightforums::atomicFile::verify(source.c_str(), source.size());
+		if (checksum == lightforums::atomicFile::CHECKSUM_WRONG) {
+			std::cerr << fileName << " is damaged" << std::endl;
+			return false;
+		}
+		if (checksum == lightforums::atomicFile::CHECKSUM_MISSING) std::cerr << fileName << " has no checksum, it's older or incomplete" << std::endl;
 		rapidxml::xml_document<> docSource;
-		docSource.parse<0>((char*)source.c_str());
+		try {
+			docSource.parse<0>((char*)source.c_str());
+		} catch (rapidxml::parse_error& error) {
+			std::cerr << "Could not parse " << fileName << ": " << error.what() << std::endl;
+			return false;
+		}
 		rapidxml::xml_node<>* parent = docSource.first_node();
 		if (parent) {
 			std::cerr << "All right, reading\n";
 			rapidxml::xml_node<>* settingsNode = parent->first_node("settings");
 			lightforums::Settings::get().setup(settingsNode);
-			rapidxml::xml_node<>* usersNode = parent->first_node("users");
-			lightforums::userList::get().setupUserList(usersNode);
+			// Threads and users are built in parallel, threads are linked under the root afterwards
+			std::vector<std::function<void ()>> tasks;
 			rapidxml::xml_node<>* postsNode = parent->first_node("posts");
-			if (!postsNode) return;
-			rapidxml::xml_node<>* postNode = postsNode->first_node("post");
-			if (!postNode) return;
-			lightforums::post* firstPost = new lightforums::post(nullptr, postNode);
-			root::get().setRootPost(firstPost->self());
-			lightforums::userList::get().digestPost(root::get().getRootPost());
-			rapidxml::xml_node<>* translationsNode = parent->first_node("translation");
-			if (translationsNode) lightforums::tr::getInstance().init(translationsNode);
+			rapidxml::xml_node<>* postNode = postsNode ? postsNode->first_node("post") : nullptr;
+			std::vector<std::shared_ptr<lightforums::post>> threads;
+			if (postNode) for (rapidxml::xml_node<>* thread = postNode->first_node("post"); thread; thread = thread->next_sibling("post")) {
+				unsigned int index = threads.size();
+				threads.push_back(nullptr);
+				tasks.push_back([thread, index, &threads] () {
+					lightforums::post* made = new lightforums::post(nullptr, thread);
+					made->updateActivity();
+					threads[index] = made->self();
+				});
+			}
+			rapidxml::xml_node<>* usersNode = parent->first_node("users");
+			std::vector<rapidxml::xml_node<>*> userNodes;
+			if (usersNode) for (rapidxml::xml_node<>* node = usersNode->first_node("user"); node; node = node->next_sibling("user")) userNodes.push_back(node);
+			for (unsigned int start = 0; start < userNodes.size(); start += USERS_PER_TASK) {
+				tasks.push_back([start, &userNodes] () {
+					for (unsigned int i = start; i < userNodes.size() && i < start + USERS_PER_TASK; i++) lightforums::userList::get().loadUser(userNodes[i]);
+				});
+			}
+			lightforums::runInParallel(tasks);
+			lightforums::userList::get().setupUserList(nullptr);
+			if (!postNode) return true;
+
+			lightforums::post* firstPost = new lightforums::post(nullptr, postNode, false);
+			std::shared_ptr<lightforums::post> rootPost = firstPost->self();
+			time_t lastActivity = rootPost->postedAt_;
+			for (unsigned int i = 0; i < threads.size(); i++) {
+				if (!threads[i]->placeAt(rootPost, threads[i]->getId())) {
+					std::cerr << "Thread " << threads[i]->getId() << " is in " << fileName << " twice, the second one is lost" << std::endl;
+					// It added itself when it was made, maybe before the kept one, which is added again
+					lightforums::postIndex::get().remove(threads[i]);
+					auto kept = rootPost->children_.find(threads[i]->getId());
+					if (kept != rootPost->children_.end()) lightforums::postIndex::get().addSubtree(kept->second);
+					threads[i]->discard();
+					continue;
+				}
+				if (threads[i]->lastActivity_ > lastActivity) lastActivity = threads[i]->lastActivity_;
+			}
+			rootPost->lastActivity_.store(lastActivity);
+			root::get().setRootPost(rootPost);
+			for (rapidxml::xml_node<>* translationsNode = parent->first_node("translation"); translationsNode; translationsNode = translationsNode->next_sibling("translation"))
+				lightforums::tr::getInstance().init(translationsNode);
 			rapidxml::xml_node<>* cookiesNode = parent->first_node("cookies");
 			if (cookiesNode) for (rapidxml::xml_node<>* cookie = cookiesNode->first_node("cookie"); cookie; cookie = cookie->next_sibling("cookie")) {
 				rapidxml::xml_attribute<>* token = cookie->first_attribute("token");
@@ -98,60 +157,99 @@ void setupStructures(const std::string& fileName) {
 				if (!token || !user) continue;
 				root::get().cookies_.insert(token->value(), user->value());
 			}
-			return;
-		} else lightforums::userList::get().setupUserList(nullptr);
-	} lightforums::userList::get().setupUserList(nullptr);
-	lightforums::Settings::get().setup();
+			return true;
+		}
+	}
+	return false;
 }
 
-void saveStructures(const std::string& fileName) {
-	rapidxml::xml_document<> doc;
-	rapidxml::xml_node<>* decl = doc.allocate_node(rapidxml::node_declaration);
-	decl->append_attribute(doc.allocate_attribute("version", "1.0"));
-	decl->append_attribute(doc.allocate_attribute("encoding", "utf-8"));
-	doc.append_node(decl);
+time_t lastModified(const std::string& fileName) {
+	struct stat info;
+	if (stat(fileName.c_str(), &info)) return 0;
+	return info.st_mtime;
+}
 
-	rapidxml::xml_node<>* root = doc.allocate_node(rapidxml::node_element, "forums");
-	doc.append_node(root);
-	std::vector<std::shared_ptr<std::string>> strings;
-	root->append_node(lightforums::Settings::get().save(&doc, strings));
+void setupStructures(const std::string& fileName, const std::string& binaryName, const std::string& journalName) {
+	// Translations edited on the forum are saved with it, so they're read later and override these
+	lightforums::tr::getInstance().loadFiles(LOCALES_DIRECTORY);
+	// Whichever format was saved last is the current one, the setting could have been changed in between
+	// If a file can't be read, the one saved before it is tried
+	auto loadBinary = [] (const std::string& name) -> bool {
+		if (!lightforums::binarySnapshot::recognise(name)) return false;
+		std::cerr << "Reading " << name << std::endl;
+		return lightforums::binarySnapshot::load(name);
+	};
+	std::vector<std::pair<std::string, std::function<bool (const std::string&)>>> candidates;
+	candidates.push_back(std::make_pair(binaryName, loadBinary));
+	candidates.push_back(std::make_pair(fileName, loadStructures));
+	if (lastModified(binaryName) < lastModified(fileName)) std::swap(candidates[0], candidates[1]);
+	bool loaded = false;
+	for (unsigned int i = 0; i < 4 && !loaded; i++) {
+		std::string name = candidates[i / 2].first + ((i % 2) ? ".old" : "");
+		if (!lastModified(name)) continue;
+		loaded = candidates[i / 2].second(name);
+		if (!loaded) std::cerr << "Could not read " << name << std::endl;
+	}
+	if (!loaded) {
+		lightforums::Settings::get().setup();
+		lightforums::userList::get().setupUserList(nullptr);
+	}
+	// Saves made before posts had global ids refer to them by paths
+	lightforums::postIndex::get().assignMissing(root::get().getRootPost());
+	lightforums::userList::get().resolveRatings(root::get().getRootPost());
+	// Changes made after the last save, counts of posts and ratings are derived afterwards
+	lightforums::journal::get().replayAll(journalName);
+	lightforums::userList::get().digestPost(root::get().getRootPost());
+	lightforums::journal::get().open(journalName);
+	lightforums::activityPropagator::get().start();
+}
 
-	rapidxml::xml_node<>* usersNode = lightforums::userList::get().save(&doc, strings);
-	root->append_node(usersNode);
+bool saveStructures(const std::string& fileName) {
+	lightforums::epochs::snapshot view; // Changes made from now on won't be saved, the journal has them
+	lightforums::xmlWriter out;
+	if (!out.open(fileName)) {
+		std::cerr << "Could not open " << fileName << " for saving" << std::endl;
+		return false;
+	}
+	out.declaration();
+	out.startElement("forums");
+	lightforums::Settings::get().save(out);
+	lightforums::userList::get().save(out, view);
 
-	rapidxml::xml_node<>* postsNode = doc.allocate_node(rapidxml::node_element, "posts");
-	root->append_node(postsNode);
-	rapidxml::xml_node<>* postsSaved = root::get().getRootPost()->getNode(&doc, strings);
-	postsNode->append_node(postsSaved);
+	out.startElement("posts");
+	root::get().getRootPost()->save(out, view);
+	out.endElement();
 
-	rapidxml::xml_node<>* translationsSaved = lightforums::tr::getInstance().save(&doc, strings);
-	root->append_node(translationsSaved);
+	lightforums::tr::getInstance().save(out);
 
-	rapidxml::xml_node<>* cookiesSaved = doc.allocate_node(rapidxml::node_element, "cookies");
+	out.startElement("cookies");
 	for (auto it = root::get().cookies_.begin(); it != root::get().cookies_.end(); it++) {
-		rapidxml::xml_node<>* cookie = doc.allocate_node(rapidxml::node_element, "cookie");
-		cookie->append_attribute(doc.allocate_attribute("token", it->first.c_str()));
-		cookie->append_attribute(doc.allocate_attribute("user", it->second.c_str()));
-		cookiesSaved->append_node(cookie);
+		out.startElement("cookie");
+		out.attribute("token", it->first);
+		out.attribute("user", it->second);
+		out.endElement();
 	}
-	root->append_node(cookiesSaved);
+	out.endElement();
+	out.endElement();
 
-#ifdef __linux__
-	system(std::string("mv " + fileName + ".old " + fileName + ".very_old").c_str());
-	system(std::string("mv " + fileName + " " + fileName + ".old").c_str());
-#elif __APPLE__
-	system(std::string("mv " + fileName + ".old " + fileName + ".very_old").c_str());
-	system(std::string("mv " + fileName + " " + fileName + ".old").c_str());
-#elif _WIN32
-	system(std::string("move " + fileName + ".old " + fileName + ".very_old").c_str());
-	system(std::string("move " + fileName + " " + fileName + ".old").c_str());
-#endif
+	if (!out.finish()) {
+		std::cerr << "Could not save " << fileName << ", the old file is kept" << std::endl;
+		return false;
+	}
 	std::cerr << "Saved as " << fileName << std::endl;
+	return true;
+}
 
-	std::ofstream out(fileName);
-	out << doc;
-	out.close();
-	doc.clear();
+bool saveCurrent() {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool saved;
+	if (lightforums::Settings::get().saveAs == lightforums::Settings::SAVE_BINARY) {
+		saved = lightforums::binarySnapshot::save(BINARY_SAVE_FILE);
+		if (saved) std::cerr << "Saved as " << BINARY_SAVE_FILE << std::endl;
+		else std::cerr << "Could not save " << BINARY_SAVE_FILE << ", the old file is kept" << std::endl;
+	} else saved = saveStructures(SAVE_FILE);
+	std::cerr << "Saving took " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+	return saved;
 }
 
 void saveOccasionally() {
@@ -159,16 +257,20 @@ void saveOccasionally() {
 	unsigned int tillBackup = 0;
 	while (!exiting) {
 		if (waited >= lightforums::Settings::get().savingFrequency) {
-			saveStructures("saved_data.xml");
+			lightforums::journal::get().rotate();
+			if (saveCurrent()) lightforums::journal::get().dropRotated(); // Otherwise, the journal is still needed
+			std::cerr << lightforums::journal::get().describeStatistics() << std::endl;
+			std::cerr << lightforums::renderCache::get().describeStatistics() << std::endl;
 			waited = 0;
 			if (tillBackup >= lightforums::Settings::get().backupFrequency) {
-				saveStructures("backup_data.xml");
+				saveStructures(BACKUP_FILE);
 				tillBackup = 0;
 			} else tillBackup++;
 		} waited++;
 		std::this_thread::sleep_for(std::chrono::seconds(1));
 	}
-	saveStructures("saved_data.xml");
+	lightforums::journal::get().rotate();
+	if (saveCurrent()) lightforums::journal::get().dropRotated();
 	readyToExit = true;
 	std::cerr << "Ready to exit" << std::endl;
 }
@@ -189,7 +291,7 @@ int main(int argc, char** argv)
 
 	sigaction(SIGSEGV, &sa, NULL);
 #endif
-	setupStructures("saved_data.xml");
+	setupStructures(SAVE_FILE, BINARY_SAVE_FILE, JOURNAL_FILE);
 	std::thread backupThread(saveOccasionally);
 	int result = Wt::WRun(argc, argv, &createApplication);
 	exiting = true;
@@ -197,5 +299,7 @@ int main(int argc, char** argv)
 		std::this_thread::sleep_for(std::chrono::seconds(1));
 	}
 	backupThread.join();
+	lightforums::activityPropagator::get().stop();
+	lightforums::journal::get().close();
 	return result;
 }
@@ -17,24 +17,30 @@
 #include "translation.h"
 #include "userlist.h"
 #include "settings.h"
+#include "journal.h"
+#include "postindex.h"
+#include "rendercache.h"
 
 std::shared_ptr<lightforums::post> root::getRootPost() {
 	if (rootPost_) return rootPost_;
 
 	// Create a dummy one
 	lightforums::post* made = new lightforums::post();
-	made->title_ = std::make_shared<std::string>("Welcome to the forums");
-	made->text_ = std::make_shared<std::string>("Create threads or subforums within this. To manage something, log in as 'Administrator_President' with password 'freecandy' (and change your password as soon as possible).");
+	made->title_ = std::make_shared<lightforums::postText>("Welcome to the forums");
+	made->text_ = lightforums::renderCache::get().compiled(std::make_shared<lightforums::postText>("Create threads or subforums within this. To manage something, log in as 'Administrator_President' with password 'freecandy' (and change your password as soon as possible)."));
 	// This leads to password $2y$05$WiDKPizNSRb0TkrTahbmLObR0vo1STjeI4xqD2rCRqbc57.LR.SJ2 if salt is bALFMOQ7vVkUr7h5MpzI0AQU9Tc=
 	made->author_ = std::make_shared<std::string>("Administrator_President");
 	made->visibility_ = lightforums::USER;
 	made->depth_ = 1;
-	return made->self();
+	rootPost_ = made->self(); // Changes to it must not be lost
+	return rootPost_;
 }
 
 mainWindow::mainWindow(const Wt::WEnvironment& env) :
-	Wt::WApplication(env)
+	Wt::WApplication(env),
+	locale_(lightforums::tr::getInstance().findLocale(env.locale().name()))
 {
+	lightforums::tr::localeScope inLocale(locale_);
 	try {
 		std::string cookie = env.getCookie("login");
 		auto found = root::get().cookies_.find(cookie);
@@ -54,6 +60,11 @@ mainWindow::~mainWindow() {
 
 }
 
+void mainWindow::notify(const Wt::WEvent& event) {
+	lightforums::tr::localeScope inLocale(locale_);
+	Wt::WApplication::notify(event);
+}
+
 void mainWindow::rebuild() {
 	root()->clear();
 
@@ -96,7 +107,13 @@ void mainWindow::handlePathChange()
 			std::shared_ptr<lightforums::post> found = getPost(steps);
 			if (found) {
 				content = found->build(currentUser_, 1, found != root::get().getRootPost());
-				setTitle(Wt::WString(*std::atomic_load(&found->title_)));
+				setTitle(Wt::WString(std::atomic_load(&found->title_)->str()));
+			}
+		} else if (path.find(POST_ID_PREFIX "/") == 0) {
+			std::shared_ptr<lightforums::post> found = lightforums::postIndex::get().find(strtoull(path.c_str() + strlen(POST_ID_PREFIX) + 1, nullptr, 10));
+			if (found) {
+				content = found->build(currentUser_, 1, found != root::get().getRootPost());
+				setTitle(Wt::WString(std::atomic_load(&found->title_)->str()));
 			}
 		} else if (path.find(USER_PATH_PREFIX) == 0) {
 			std::string name = path.substr(strlen(USER_PATH_PREFIX) + 1);
@@ -110,19 +127,19 @@ void mainWindow::handlePathChange()
 			std::shared_ptr<lightforums::user> editor = lightforums::userList::get().getUser(currentUser_);
 			if (editor->rank_ == lightforums::ADMIN) {
 				content = lightforums::Settings::get().edit(currentUser_);
-				setTitle(Wt::WString(*lightforums::tr::get(lightforums::tr::CHANGE_SETTINGS)));
+				setTitle(Wt::WString(lightforums::tr::get(lightforums::tr::CHANGE_SETTINGS)));
 			}
 		} else if (path.find(TRANSLATION_PATH) == 0) {
 			std::shared_ptr<lightforums::user> editor = lightforums::userList::get().getUser(currentUser_);
 			if (editor->rank_ == lightforums::ADMIN) {
-				content = lightforums::tr::getInstance().edit(currentUser_);
-				setTitle(Wt::WString(*lightforums::tr::get(lightforums::tr::CHANGE_TRANSLATION)));
+				content = lightforums::tr::getInstance().edit(currentUser_, locale_);
+				setTitle(Wt::WString(lightforums::tr::get(lightforums::tr::CHANGE_TRANSLATION)));
 			}
 		}
 	}
 	if (!content) {
 		content = root::get().getRootPost()->build(currentUser_, 1);
-		setTitle(Wt::WString(*std::atomic_load(&root::get().getRootPost()->title_)));
+		setTitle(Wt::WString(std::atomic_load(&root::get().getRootPost()->title_)->str()));
 	}
 	root()->addWidget(content);
 	scrollArea_->setWidget(content);
@@ -144,54 +161,55 @@ std::shared_ptr<lightforums::post> mainWindow::getPost(lightforums::postPath pat
 void mainWindow::makeAuthBlock() {
 	authContainer_->clear();
 	Wt::WHBoxLayout* authLayout = new Wt::WHBoxLayout(authContainer_);
-	Wt::WAnchor* backToMain = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/"), Wt::WString(*lightforums::tr::get(lightforums::tr::BACK_TO_MAIN)), authContainer_);
+	Wt::WAnchor* backToMain = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/"), Wt::WString(lightforums::tr::get(lightforums::tr::BACK_TO_MAIN)), authContainer_);
 	authLayout->addWidget(backToMain);
 	if (currentUser_.empty()) {
 		authLayout->addStretch(1);
-		Wt::WPushButton* loginButton = new Wt::WPushButton(Wt::WString(*lightforums::tr::get(lightforums::tr::DO_LOG_IN)), authContainer_);
+		Wt::WPushButton* loginButton = new Wt::WPushButton(Wt::WString(lightforums::tr::get(lightforums::tr::DO_LOG_IN)), authContainer_);
 		authLayout->addWidget(loginButton);
 		loginButton->clicked().connect(std::bind([=] () {
-			Wt::WDialog* dialog = new Wt::WDialog(*lightforums::tr::get(lightforums::tr::DO_LOG_IN));
+			Wt::WDialog* dialog = new Wt::WDialog(lightforums::tr::get(lightforums::tr::DO_LOG_IN));
 			dialog->setModal(false);
 			Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(dialog->contents());
 
 			Wt::WLineEdit* nameEdit = new Wt::WLineEdit(dialog->contents());
-			nameEdit->setPlaceholderText(Wt::WString(*lightforums::tr::get(lightforums::tr::WRITE_USERNAME)));
+			nameEdit->setPlaceholderText(Wt::WString(lightforums::tr::get(lightforums::tr::WRITE_USERNAME)));
 			layout->addWidget(nameEdit);
 			Wt::WLineEdit* passwordEdit = new Wt::WLineEdit(dialog->contents());
 			passwordEdit->setEchoMode(Wt::WLineEdit::Password);
-			passwordEdit->setPlaceholderText(Wt::WString(*lightforums::tr::get(lightforums::tr::WRITE_PASSWORD)));
+			passwordEdit->setPlaceholderText(Wt::WString(lightforums::tr::get(lightforums::tr::WRITE_PASSWORD)));
 			layout->addWidget(passwordEdit);
 
 			Wt::WContainerWidget* buttonContainer = new Wt::WContainerWidget(dialog->contents());
 			layout->addWidget(buttonContainer);
 			Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(buttonContainer);
-			Wt::WPushButton* loginButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::DO_LOG_IN), buttonContainer);
+			Wt::WPushButton* loginButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::DO_LOG_IN), buttonContainer);
 			loginButton->setDefault(true);
 			buttonLayout->addStretch(1);
 			buttonLayout->addWidget(loginButton);
 
 			loginButton->clicked().connect(std::bind([=] () {
 				std::shared_ptr<lightforums::user> found = lightforums::userList::get().getUser(nameEdit->text().toUTF8());
-				if (!found) lightforums::messageBox(*lightforums::tr::get(lightforums::tr::LOGIN_ERROR), *lightforums::tr::get(lightforums::tr::NO_SUCH_USER));
+				if (!found) lightforums::messageBox(lightforums::tr::get(lightforums::tr::LOGIN_ERROR), lightforums::tr::get(lightforums::tr::NO_SUCH_USER));
 				else {
 //					std::string salt = lightforums::safeRandomString();
 					static Wt::Auth::BCryptHashFunction cryptHasher(5);
 //					found->salt_ = std::make_shared<std::string>(salt); // Enable this to make login attempt change the password to the written one
 //					found->password_ = std::make_shared<std::string>(cryptHasher.compute(passwordEdit->text().toUTF8(), salt));
 					if (!cryptHasher.verify(passwordEdit->text().toUTF8(), *found->salt_, *found->password_))
-						lightforums::messageBox(*lightforums::tr::get(lightforums::tr::LOGIN_ERROR), *lightforums::tr::get(lightforums::tr::WRONG_PASSWORD));
+						lightforums::messageBox(lightforums::tr::get(lightforums::tr::LOGIN_ERROR), lightforums::tr::get(lightforums::tr::WRONG_PASSWORD));
 					else {
 						currentUser_ = *found->name_;
 						std::string cookie = lightforums::safeRandomString();
 						setCookie("login", cookie, INT_MAX); // Cookie forever, it's very, very small
 						root::get().cookies_.insert(cookie, currentUser_);
+						lightforums::journal::get().cookieAdded(cookie, currentUser_);
 						dialog->accept();
 						rebuild();
 					}
 				}
 			}));
-			Wt::WPushButton* dontLoginButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::CANCEL_LOG_IN), buttonContainer);
+			Wt::WPushButton* dontLoginButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::CANCEL_LOG_IN), buttonContainer);
 			buttonLayout->addWidget(dontLoginButton);
 
 			dontLoginButton->clicked().connect(std::bind([=] () {
@@ -203,20 +221,22 @@ void mainWindow::makeAuthBlock() {
 
 		}));
 	} else {
-		Wt::WAnchor* profile = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" USER_PATH_PREFIX "/" + currentUser_), Wt::WString(*lightforums::tr::get(lightforums::tr::MY_ACCOUNT)), authContainer_);
+		Wt::WAnchor* profile = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" USER_PATH_PREFIX "/" + currentUser_), Wt::WString(lightforums::tr::get(lightforums::tr::MY_ACCOUNT)), authContainer_);
 		authLayout->addWidget(profile);
 		std::shared_ptr<lightforums::user> viewer = lightforums::userList::get().getUser(currentUser_);
 		if (viewer && viewer->rank_ == lightforums::ADMIN) {
-			Wt::WAnchor* showSettings = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" SETTINGS_PATH), Wt::WString(*lightforums::tr::get(lightforums::tr::CHANGE_SETTINGS)), authContainer_);
+			Wt::WAnchor* showSettings = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" SETTINGS_PATH), Wt::WString(lightforums::tr::get(lightforums::tr::CHANGE_SETTINGS)), authContainer_);
 			authLayout->addWidget(showSettings);
 		}
 
 		authLayout->addStretch(1);
-		authLayout->addWidget(new Wt::WText(Wt::WString(lightforums::replaceVar(*lightforums::tr::get(lightforums::tr::LOGGED_IN_AS), 'X', currentUser_))));
-		Wt::WPushButton* logoutButton = new Wt::WPushButton(Wt::WString(*lightforums::tr::get(lightforums::tr::DO_LOG_OUT)), authContainer_);
+		authLayout->addWidget(new Wt::WText(Wt::WString(lightforums::replaceVar(lightforums::tr::get(lightforums::tr::LOGGED_IN_AS), 'X', currentUser_))));
+		Wt::WPushButton* logoutButton = new Wt::WPushButton(Wt::WString(lightforums::tr::get(lightforums::tr::DO_LOG_OUT)), authContainer_);
 		authLayout->addWidget(logoutButton);
 		logoutButton->clicked().connect(std::bind([=] () {
-			root::get().cookies_.erase(environment().getCookie("login"));
+			const std::string& cookie = environment().getCookie("login");
+			root::get().cookies_.erase(cookie);
+			lightforums::journal::get().cookieRemoved(cookie);
 			setCookie("login", "", 0);
 			currentUser_.clear();
 			rebuild();
@@ -224,29 +244,29 @@ void mainWindow::makeAuthBlock() {
 	}
 
 	if ((currentUser_.empty() && lightforums::Settings::get().canRegister) || lightforums::userList::get().getUser(currentUser_)->rank_ == lightforums::ADMIN) {
-		Wt::WPushButton* registerButton = new Wt::WPushButton(Wt::WString(*lightforums::tr::get(lightforums::tr::DO_REGISTER)), authContainer_);
+		Wt::WPushButton* registerButton = new Wt::WPushButton(Wt::WString(lightforums::tr::get(lightforums::tr::DO_REGISTER)), authContainer_);
 		authLayout->addWidget(registerButton);
 		registerButton->clicked().connect(std::bind([=] () {
 
-			Wt::WDialog* dialog = new Wt::WDialog(*lightforums::tr::get(lightforums::tr::DO_LOG_IN));
+			Wt::WDialog* dialog = new Wt::WDialog(lightforums::tr::get(lightforums::tr::DO_LOG_IN));
 			dialog->setModal(false);
 			Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(dialog->contents());
 
 			Wt::WLineEdit* nameEdit = new Wt::WLineEdit(dialog->contents());
-			nameEdit->setPlaceholderText(Wt::WString(*lightforums::tr::get(lightforums::tr::WRITE_USERNAME)));
+			nameEdit->setPlaceholderText(Wt::WString(lightforums::tr::get(lightforums::tr::WRITE_USERNAME)));
 			layout->addWidget(nameEdit);
 			Wt::WLineEdit* passwordEdit[2];
 			for (int i = 0; i <= 1; i++) {
 				passwordEdit[i] = new Wt::WLineEdit(dialog->contents());
 				passwordEdit[i]->setEchoMode(Wt::WLineEdit::Password);
-				passwordEdit[i]->setPlaceholderText(Wt::WString(*lightforums::tr::get((i == 0) ? lightforums::tr::WRITE_PASSWORD : lightforums::tr::REWRITE_PASSWORD)));
+				passwordEdit[i]->setPlaceholderText(Wt::WString(lightforums::tr::get((i == 0) ? lightforums::tr::WRITE_PASSWORD : lightforums::tr::REWRITE_PASSWORD)));
 				layout->addWidget(passwordEdit[i]);
 			}
 
 			Wt::WContainerWidget* buttonContainer = new Wt::WContainerWidget(dialog->contents());
 			layout->addWidget(buttonContainer);
 			Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(buttonContainer);
-			Wt::WPushButton* registerButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::DO_REGISTER), buttonContainer);
+			Wt::WPushButton* registerButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::DO_REGISTER), buttonContainer);
 			registerButton->setDefault(true);
 			buttonLayout->addStretch(1);
 			buttonLayout->addWidget(registerButton);
@@ -254,8 +274,8 @@ void mainWindow::makeAuthBlock() {
 			registerButton->clicked().connect(std::bind([=] () {
 				std::string username = nameEdit->text().toUTF8();
 				std::shared_ptr<lightforums::user> found = lightforums::userList::get().getUser(username);
-				if (found) lightforums::messageBox(*lightforums::tr::get(lightforums::tr::REGISTER_ERROR), *lightforums::tr::get(lightforums::tr::USERNAME_UNAVAILABLE));
-				else if (passwordEdit[0]->text() != passwordEdit[1]->text()) lightforums::messageBox(*lightforums::tr::get(lightforums::tr::REGISTER_ERROR), *lightforums::tr::get(lightforums::tr::PASSWORDS_DONT_MATCH));
+				if (found) lightforums::messageBox(lightforums::tr::get(lightforums::tr::REGISTER_ERROR), lightforums::tr::get(lightforums::tr::USERNAME_UNAVAILABLE));
+				else if (passwordEdit[0]->text() != passwordEdit[1]->text()) lightforums::messageBox(lightforums::tr::get(lightforums::tr::REGISTER_ERROR), lightforums::tr::get(lightforums::tr::PASSWORDS_DONT_MATCH));
 				else {
 					if (lightforums::user::validateUsername(username)) {
 						std::shared_ptr<lightforums::user> made = std::make_shared<lightforums::user>();
@@ -270,16 +290,17 @@ void mainWindow::makeAuthBlock() {
 							std::string cookie = lightforums::safeRandomString();
 							setCookie("login", cookie, INT_MAX); // Cookie forever, it's very, very small
 							root::get().cookies_.insert(cookie, currentUser_);
+							lightforums::journal::get().cookieAdded(cookie, currentUser_);
 							dialog->accept();
 							rebuild();
 						} else {
-							lightforums::messageBox(*lightforums::tr::get(lightforums::tr::REGISTER_ERROR), *lightforums::tr::get(lightforums::tr::USERNAME_UNAVAILABLE));
+							lightforums::messageBox(lightforums::tr::get(lightforums::tr::REGISTER_ERROR), lightforums::tr::get(lightforums::tr::USERNAME_UNAVAILABLE));
 						}
 					}
 				}
 			}));
 
-			Wt::WPushButton* dontRegisterButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::CANCEL_ACCOUNT_CREATION), buttonContainer);
+			Wt::WPushButton* dontRegisterButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::CANCEL_ACCOUNT_CREATION), buttonContainer);
 			buttonLayout->addWidget(dontRegisterButton);
 
 			dontRegisterButton->clicked().connect(std::bind([=] () {
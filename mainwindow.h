@@ -4,6 +4,7 @@
 #include <Wt/WApplication>
 #include <Wt/WContainerWidget>
 #include "post.h"
+#include "translation.h"
 
 class root {
 public:
@@ -32,12 +33,16 @@ public:
 	mainWindow(const Wt::WEnvironment& env);
 	~mainWindow();
 
+protected:
+	void notify(const Wt::WEvent& event) override; // Handles everything in the session's locale
+
 private:
 	void handlePathChange();
 	std::shared_ptr<lightforums::post> getPost(lightforums::postPath path);
 	Wt::WScrollArea* scrollArea_;
 	Wt::WContainerWidget* authContainer_;
 	std::string currentUser_;
+	const lightforums::tr::catalog* locale_;
 
 	void rebuild();
 	void makeAuthBlock();
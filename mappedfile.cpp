@@ -0,0 +1,49 @@
+#include "mappedfile.h"
+
+#include <iostream>
+#include <fstream>
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+std::shared_ptr<lightforums::mappedFile> lightforums::mappedFile::open(const std::string& fileName) {
+	std::shared_ptr<mappedFile> result(new mappedFile());
+#if defined(__linux__) || defined(__APPLE__)
+	int file = ::open(fileName.c_str(), O_RDONLY);
+	if (file < 0) return nullptr;
+	struct stat info;
+	// Small files are read, there can be a lot of them and the number of mappings is limited
+	if (!fstat(file, &info) && info.st_size >= 1 << 16) {
+		void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, info.st_size, MADV_SEQUENTIAL); // Loading reads it from start to end
+			result->data_ = (const char*)mapping;
+			result->size_ = info.st_size;
+			result->mapped_ = true;
+		}
+	}
+	::close(file);
+	if (result->mapped_) return result;
+#endif
+	std::ifstream in(fileName, std::ios::binary);
+	if (!in.is_open()) return nullptr;
+	result->read_ = std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	result->data_ = result->read_.c_str();
+	result->size_ = result->read_.size();
+	return result;
+}
+
+void lightforums::mappedFile::loadingFinished() {
+#if defined(__linux__) || defined(__APPLE__)
+	if (mapped_) madvise((void*)data_, size_, MADV_RANDOM);
+#endif
+}
+
+lightforums::mappedFile::~mappedFile() {
+#if defined(__linux__) || defined(__APPLE__)
+	if (mapped_) munmap((void*)data_, size_);
+#endif
+}
@@ -0,0 +1,36 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <memory>
+
+namespace lightforums {
+
+	class mappedFile {
+		// Read-only view of a whole file. Where mmap is available, the contents are paged in from the file
+		// on demand and can be dropped by the system when memory is short, elsewhere (or if it's small) the file is read.
+		// Saves never overwrite a file in place, they move it aside, so the mapped contents stay unchanged.
+	public:
+		static std::shared_ptr<mappedFile> open(const std::string& fileName);
+		~mappedFile();
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+		bool mapped() const { return mapped_; }
+		void loadingFinished(); // Further reads will be scattered, stops reading ahead
+
+	private:
+		mappedFile() : data_(nullptr), size_(0), mapped_(false) {}
+
+		const char* data_;
+		size_t size_;
+		bool mapped_;
+		std::string read_; // Used only if mapping failed
+
+		mappedFile(const mappedFile&) = delete;
+		void operator=(const mappedFile&) = delete;
+	};
+
+}
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,379 @@
+#include "markup.h"
+#include "escape.h"
+#include <algorithm>
+
+namespace {
+
+	const uint32_t noMatch = 0xffffffffu;
+	const char pairMarks[] = { '_', '*', '-', '^', '~' };
+	const lightforums::markupParser::markup pairStyles[] = { lightforums::markupParser::ITALIC, lightforums::markupParser::BOLD,
+															 lightforums::markupParser::STRIKETHROUGH, lightforums::markupParser::SUPERSCRIPT,
+															 lightforums::markupParser::SUBSCRIPT };
+
+	inline int pairKind(char character) {
+		switch (character) {
+			case '_': return 0;
+			case '*': return 1;
+			case '-': return 2;
+			case '^': return 3;
+			case '~': return 4;
+			default: return -1;
+		}
+	}
+
+	inline bool isSpace(char character) {
+		return character == ' ' || character == '\t' || character == '\n';
+	}
+
+	inline bool isPunctuation(char character) {
+		return character == '.' || character == ',' || character == ';' || character == '?' || character == '!';
+	}
+
+	void openTags(unsigned int flags, std::string& into) {
+		if (flags & lightforums::markupParser::CODE) into += "<tt>";
+		if (flags & lightforums::markupParser::ITALIC) into += "<em>";
+		if (flags & lightforums::markupParser::BOLD) into += "<strong>";
+		if (flags & lightforums::markupParser::STRIKETHROUGH) into += "<strike>";
+		if (flags & lightforums::markupParser::SUPERSCRIPT) into += "<sup>";
+		if (flags & lightforums::markupParser::SUBSCRIPT) into += "<sub>";
+		if (flags & lightforums::markupParser::HEADING) into += "<h1>";
+	}
+
+	void closeTags(unsigned int flags, std::string& into) {
+		if (flags & lightforums::markupParser::HEADING) into += "</h1>";
+		if (flags & lightforums::markupParser::SUBSCRIPT) into += "</sub>";
+		if (flags & lightforums::markupParser::SUPERSCRIPT) into += "</sup>";
+		if (flags & lightforums::markupParser::STRIKETHROUGH) into += "</strike>";
+		if (flags & lightforums::markupParser::BOLD) into += "</strong>";
+		if (flags & lightforums::markupParser::ITALIC) into += "</em>";
+		if (flags & lightforums::markupParser::CODE) into += "</tt>";
+	}
+
+}
+
+lightforums::markupParser::markupParser(const char* text, size_t size) :
+	text_(text),
+	size_(size),
+	runFrom_(1),
+	runTo_(0)
+{
+}
+
+lightforums::markupParser::level lightforums::markupParser::makeLevel(size_t start, size_t end, size_t resume, unsigned int flags, size_t pathStart, size_t pathSize, bool reparsed) {
+	level made;
+	made.start = start;
+	made.end = end;
+	made.resume = resume;
+	made.flags = flags;
+	made.pathStart = pathStart;
+	made.pathSize = pathSize;
+	made.spoiler = false;
+	made.code = false;
+	made.reparsed = reparsed;
+	made.begun = false;
+	made.hasParts = false;
+	made.afterPart = false;
+	made.at = start;
+	made.textFrom = start;
+	made.checkedAt = noMatch;
+	made.styleFrom = 0;
+	made.styleTo = 0;
+	made.styleFlags = 0;
+	return made;
+}
+
+void lightforums::markupParser::findPairs() {
+	match_.assign(size_, noMatch);
+	// Code first, nothing inside it is markup. It ends at the next `, even if that's escaped
+	size_t codeStart = size_;
+	for (size_t at = 0; at < size_; at++) {
+		if (text_[at] != '`') continue;
+		if (codeStart != size_) {
+			match_[codeStart] = at;
+			match_[at] = codeStart;
+			codeStart = size_;
+		} else if (at == 0 || text_[at - 1] != '\\') codeStart = at;
+	}
+
+	std::vector<uint32_t> braces;
+	std::vector<uint32_t> brackets;
+	std::vector<uint32_t> headings;
+	for (size_t at = 0; at < size_; at++) {
+		char character = text_[at];
+		bool escaped = (at > 0 && text_[at - 1] == '\\');
+		switch (character) {
+			case '`':
+				if (match_[at] != noMatch && match_[at] > at) at = match_[at];
+				break;
+			case '{':
+				if (!escaped) braces.push_back(at);
+				break;
+			case '}':
+				if (!escaped && !braces.empty()) {
+					match_[braces.back()] = at;
+					braces.pop_back();
+				}
+				break;
+			case '[':
+				if (!escaped) brackets.push_back(at);
+				break;
+			case '|': // The caption of a link ends with it, but it can contain other links
+				if (!escaped && !brackets.empty()) {
+					match_[brackets.back()] = at;
+					brackets.pop_back();
+				}
+				break;
+			case '!':
+				headings.push_back(at);
+				break;
+			case '\n':
+				if (!escaped) {
+					for (unsigned int i = 0; i < headings.size(); i++) match_[headings[i]] = at;
+					headings.clear();
+				}
+				break;
+			default:
+				int kind = pairKind(character);
+				if (kind < 0) break;
+				if (!escaped && (at + 1 == size_ || isSpace(text_[at + 1]) || isPunctuation(text_[at + 1])))
+					closers_[kind].push_back(at);
+				if (at == 0 || isSpace(text_[at - 1])) {
+					size_t firstOther = at + 1;
+					while (firstOther < size_ && pairKind(text_[firstOther]) >= 0) firstOther++;
+					if (firstOther == size_ || !isSpace(text_[firstOther])) openers_[kind].push_back(opener{uint32_t(at), uint32_t(firstOther)});
+				}
+		}
+	}
+}
+
+size_t lightforums::markupParser::findCloser(int kind, size_t from, size_t end) {
+	const std::vector<uint32_t>& closers = closers_[kind];
+	auto found = std::lower_bound(closers.begin(), closers.end(), from);
+	if (found != closers.end() && *found + 1 < end) return *found;
+	// The end of the contents of anything ends a style like the end of the text does
+	if (end > from && text_[end - 1] == pairMarks[kind] && text_[end - 2] != '\\') return end - 1;
+	return end;
+}
+
+size_t lightforums::markupParser::findEndingOpener(size_t from, size_t end, size_t& firstOther) {
+	// Text that was gone through already can start a style only if it ends with its mark
+	if (end < from + 2) return noMatch;
+	int kind = pairKind(text_[end - 1]);
+	if (kind < 0 || text_[end - 2] == '\\') return noMatch;
+	const std::vector<opener>& openers = openers_[kind];
+	auto found = std::lower_bound(openers.begin(), openers.end(), from, [] (const opener& one, size_t at) { return one.at < at; });
+	// Any later one would be inside the row of marks of this one
+	if (found == openers.end() || found->firstOther + 1 > end) return noMatch;
+	firstOther = found->firstOther;
+	return found->at;
+}
+
+size_t lightforums::markupParser::runEnd(size_t from) {
+	// Styles within styles start at the same row of marks, it's not searched again
+	if (from >= runFrom_ && from <= runTo_) return runTo_;
+	size_t to = from;
+	while (to < size_ && pairKind(text_[to]) >= 0) to++;
+	runFrom_ = from;
+	runTo_ = to;
+	return to;
+}
+
+void lightforums::markupParser::addText(size_t from, size_t to, unsigned int flags, const level& in, markupSink& into) {
+	std::string html;
+	html.reserve(to - from + 16);
+	openTags(flags, html);
+	for (size_t at = from; at < to; at++) {
+		// Runs of characters that stay as they are are copied at once
+		size_t plain = escaper::findSpecial(text_ + at, to - at, escaper::MARKUP_SPECIAL);
+		html.append(text_ + at, plain);
+		at += plain;
+		if (at == to) break;
+		char character = text_[at];
+		char next = (at + 1 < to) ? text_[at + 1] : 0;
+		if (character == '\n') {
+			html.append("<br/>");
+		} else if (character == '\\' && next == '\\') {
+			html.push_back('\\');
+			at++;
+		} else if (character == ' ' && next == ' ') {
+			html.append("&nbsp;");
+			at++;
+		} else if (character == '<') {
+			html.append("&lt;");
+		} else if (character == '>') {
+			html.append("&gt;");
+		} else if (character == '&') {
+			html.append("&#38;");
+		} else if (character == '"') {
+			html.append("&#34;");
+		} else if (character == '\'') {
+			html.append("&#39;");
+		} else if (character == '\\' && (next == '_' || next == '*' || next == '-' || next == '~' || next == '`' || next == '!' || next == '{' || next == '}' || next == ']' || next == '|')) {}
+		else html.push_back(character);
+	}
+	closeTags(flags, html);
+	if (flags & LINK) into.addLink(html, text_ + in.pathStart, in.pathSize);
+	else into.addHtml(html);
+}
+
+void lightforums::markupParser::openPart(std::vector<level>& levels, size_t textTo, const level& part) {
+	level& in = levels.back();
+	// The text before it is shown first, it's pushed last
+	level text = makeLevel(in.textFrom, textTo, textTo, in.flags, in.pathStart, in.pathSize, true);
+	in.hasParts = true;
+	in.at = in.textFrom = part.resume;
+	levels.push_back(part);
+	if (text.start < textTo) levels.push_back(text);
+}
+
+void lightforums::markupParser::stepFresh(std::vector<level>& levels, markupSink& into) {
+	level& in = levels.back();
+	size_t at = in.at;
+	if (at >= in.end) {
+		if (in.textFrom < in.end && in.hasParts) {
+			size_t textFrom = in.textFrom;
+			in.textFrom = in.end;
+			levels.push_back(makeLevel(textFrom, in.end, in.end, in.flags, in.pathStart, in.pathSize, true));
+			return;
+		}
+		// Contents that are only text are shown even if empty, because of their style
+		if (!in.hasParts) addText(in.textFrom, in.end, in.flags, in, into);
+		if (in.spoiler) into.addSpoiler(false);
+		levels.pop_back();
+		return;
+	}
+
+	char character = text_[at];
+	bool escaped = (at != in.start && text_[at - 1] == '\\');
+	if (character == '!' && (at == in.start || text_[at - 1] == '\n')) {
+		size_t lineEnd = match_[at];
+		if (lineEnd == noMatch || lineEnd >= in.end) openPart(levels, at, makeLevel(at + 1, in.end, in.end, in.flags ^ HEADING, in.pathStart, in.pathSize, false));
+		else openPart(levels, at, makeLevel(at + 1, lineEnd, lineEnd + 1, in.flags ^ HEADING, in.pathStart, in.pathSize, false));
+		return;
+	}
+	if (character == '{' && !escaped && match_[at] < in.end) {
+		level spoiler = makeLevel(at + 1, match_[at], match_[at] + 1, in.flags, in.pathStart, in.pathSize, false);
+		spoiler.spoiler = true;
+		openPart(levels, at, spoiler);
+		return;
+	}
+	if (character == '[' && !escaped && match_[at] < in.end) {
+		size_t pathEnd = match_[at] + 1;
+		while (pathEnd < in.end && text_[pathEnd] != ']') pathEnd++;
+		openPart(levels, at, makeLevel(at + 1, match_[at], std::min(pathEnd + 1, in.end), in.flags ^ LINK, match_[at] + 1, pathEnd - match_[at] - 1, false));
+		return;
+	}
+	int kind = pairKind(character);
+	if (kind >= 0 && (at == in.start || isSpace(text_[at - 1]))) {
+		// It must be followed by something else than marks before the next space
+		size_t firstOther = std::min(runEnd(at + 1), in.end);
+		if (firstOther == in.end || !isSpace(text_[firstOther])) {
+			size_t closer = findCloser(kind, firstOther, in.end);
+			if (closer < in.end) {
+				// A mark that could end it right after the marks is shown, like _. or _-
+				bool keepMark = (text_[firstOther - 1] == character && isPunctuation(text_[firstOther]));
+				openPart(levels, keepMark ? at + 1 : at, makeLevel(at + 1, closer, closer + 1, in.flags ^ pairStyles[kind], in.pathStart, in.pathSize, false));
+				return;
+			}
+		}
+	}
+	if (character == '`' && !escaped && match_[at] != noMatch && match_[at] > at && match_[at] < in.end) {
+		level code = makeLevel(at + 1, match_[at], match_[at] + 1, in.flags ^ CODE, in.pathStart, in.pathSize, false);
+		code.code = true;
+		openPart(levels, at, code);
+		return;
+	}
+	in.at++;
+}
+
+void lightforums::markupParser::stepReparsed(std::vector<level>& levels, markupSink& into) {
+	level& in = levels.back();
+	if (in.styleTo) {
+		level style = makeLevel(in.styleFrom, in.styleTo, in.end, in.styleFlags, in.pathStart, in.pathSize, true);
+		in.styleTo = 0;
+		in.at = in.end;
+		levels.push_back(style);
+		return;
+	}
+	size_t at = in.at;
+	if (at >= in.end) {
+		if (!in.hasParts) addText(in.start, in.end, in.flags, in, into);
+		levels.pop_back();
+		return;
+	}
+
+	// Only its start is a start where it wasn't before
+	if (!in.afterPart && in.checkedAt != at) {
+		in.checkedAt = at;
+		if (text_[at] == '!') {
+			size_t lineEnd = match_[at];
+			size_t to = (lineEnd == noMatch || lineEnd >= in.end) ? in.end : lineEnd;
+			in.hasParts = true;
+			in.afterPart = true;
+			in.at = (to == in.end) ? in.end : to + 1;
+			levels.push_back(makeLevel(at + 1, to, in.at, in.flags ^ HEADING, in.pathStart, in.pathSize, true));
+			return;
+		}
+		int kind = pairKind(text_[at]);
+		if (kind >= 0) {
+			size_t firstOther = std::min(runEnd(at + 1), in.end);
+			if (firstOther == in.end || !isSpace(text_[firstOther])) {
+				size_t closer = findCloser(kind, firstOther, in.end);
+				if (closer < in.end) {
+					if (text_[firstOther - 1] == text_[at] && isPunctuation(text_[firstOther])) addText(at, at + 1, in.flags, in, into);
+					in.hasParts = true;
+					in.afterPart = true;
+					in.at = closer + 1;
+					levels.push_back(makeLevel(at + 1, closer, closer + 1, in.flags ^ pairStyles[kind], in.pathStart, in.pathSize, true));
+					return;
+				}
+			}
+		}
+	}
+
+	// And its end is an end where it wasn't before
+	size_t firstOther = 0;
+	size_t opening = findEndingOpener(at, in.end, firstOther);
+	if (opening != noMatch) {
+		bool keepMark = (text_[firstOther - 1] == text_[opening] && isPunctuation(text_[firstOther]));
+		size_t textTo = keepMark ? opening + 1 : opening;
+		in.styleFrom = opening + 1;
+		in.styleTo = in.end - 1;
+		in.styleFlags = in.flags ^ pairStyles[pairKind(text_[opening])];
+		in.hasParts = true;
+		if (at < textTo) levels.push_back(makeLevel(at, textTo, textTo, in.flags, in.pathStart, in.pathSize, true));
+		return;
+	}
+	if (in.afterPart) {
+		// What follows the last part is parsed once more on its own
+		in.afterPart = false;
+		return;
+	}
+	addText(at, in.end, in.flags, in, into);
+	in.hasParts = true;
+	in.at = in.end;
+}
+
+bool lightforums::markupParser::parse(markupSink& into) {
+	if (escaper::findSpecial(text_, size_, escaper::MARKUP_START) == size_) {
+		// Most posts have no markup at all, they only need escaping
+		addText(0, size_, PLAIN, makeLevel(0, size_, size_, PLAIN, 0, 0, false), into);
+		return false;
+	}
+	findPairs();
+	std::vector<level> levels;
+	levels.push_back(makeLevel(0, size_, size_, PLAIN, 0, 0, false));
+	while (!levels.empty()) {
+		level& in = levels.back();
+		if (!in.begun) {
+			in.begun = true;
+			if (in.spoiler) into.addSpoiler(true);
+		}
+		if (in.code) {
+			addText(in.start, in.end, in.flags, in, into);
+			levels.pop_back();
+		} else if (in.reparsed) stepReparsed(levels, into);
+		else stepFresh(levels, into);
+	}
+	return true;
+}
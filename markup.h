@@ -0,0 +1,99 @@
+#ifndef MARKUP_H
+#define MARKUP_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace lightforums {
+
+	class markupSink {
+		// Where the parser puts what it found, so it doesn't depend on how it's shown
+	public:
+		virtual ~markupSink() {}
+		virtual void addHtml(const std::string& html) = 0;
+		virtual void addLink(const std::string& html, const char* path, size_t pathSize) = 0; // The HTML is the caption
+		virtual void addSpoiler(bool start) = 0;
+	};
+
+	class markupParser {
+		// Turns the markup of posts into HTML in one pass. Where every construct ends is found beforehand
+		// for all of them at once, so nothing is scanned more than a constant number of times, whatever
+		// the text is. Nested constructs are kept on a stack, not in recursion, so deep nesting can't
+		// run out of stack either.
+		//   !heading            at the start of a line, until its end
+		//   {spoiler}           can be nested
+		//   [caption|path]
+		//   `code`              shown as it is, nothing inside is markup
+		//   _italic_ *bold* -strikethrough- ^superscript^ ~subscript~
+		//                       start after a space or a line break and end before a space, a line break
+		//                       or punctuation, the same mark inside switches the style back off
+		// A backslash before a mark makes it an ordinary character.
+	public:
+		markupParser(const char* text, size_t size);
+		bool parse(markupSink& into); // False if there was no markup in it
+
+		enum markup : unsigned int {
+			PLAIN = 0x0,
+			HEADING = 0x1,
+			SPOILER = 0x2,
+			ITALIC = 0x4,
+			BOLD = 0x8,
+			CODE = 0x10,
+			STRIKETHROUGH = 0x20,
+			SUBSCRIPT = 0x40,
+			SUPERSCRIPT = 0x80,
+			LINK = 0x100,
+		};
+
+	private:
+		struct level {
+			size_t start;
+			size_t end; // Where its contents end
+			size_t resume; // Where to continue after it
+			unsigned int flags;
+			size_t pathStart;
+			size_t pathSize;
+			bool spoiler;
+			bool code;
+			// Text between parts of anything is parsed once more on its own, it's gone through already
+			// with the same characters around, so only what's at its start or end can turn out differently
+			bool reparsed;
+			bool begun;
+			bool hasParts; // Anything was shown of its contents
+			bool afterPart;
+			size_t at;
+			size_t textFrom;
+			size_t checkedAt;
+			size_t styleFrom; // A style to open after the text in front of it is shown
+			size_t styleTo;
+			unsigned int styleFlags;
+		};
+		struct opener {
+			uint32_t at;
+			uint32_t firstOther; // Where the row of marks it starts ends
+		};
+
+		level makeLevel(size_t start, size_t end, size_t resume, unsigned int flags, size_t pathStart, size_t pathSize, bool reparsed);
+		void findPairs();
+		size_t findCloser(int kind, size_t from, size_t end);
+		size_t findEndingOpener(size_t from, size_t end, size_t& firstOther);
+		size_t runEnd(size_t from);
+		void stepFresh(std::vector<level>& levels, markupSink& into);
+		void stepReparsed(std::vector<level>& levels, markupSink& into);
+		void openPart(std::vector<level>& levels, size_t textTo, const level& part);
+		void addText(size_t from, size_t to, unsigned int flags, const level& in, markupSink& into);
+
+		const char* text_;
+		size_t size_;
+		std::vector<uint32_t> match_; // For each `, { and [ where it ends, for each ! where its line ends
+		std::vector<uint32_t> closers_[5]; // Positions where each of the pair marks can end a style
+		std::vector<opener> openers_[5]; // Positions where each of them can start one
+		size_t runFrom_; // The last row of marks seen, for texts made only of marks
+		size_t runTo_;
+	};
+
+}
+
+#endif // MARKUP_H
@@ -1,6 +1,8 @@
 #include "post.h"
 
+#include <algorithm>
 #include "rapidxml.hpp"
+#include "xmlwriter.h"
 #include <Wt/WContainerWidget>
 #include <Wt/WGridLayout>
 #include <Wt/WVBoxLayout>
@@ -9,6 +11,7 @@
 #include <Wt/WText>
 #include <Wt/WPushButton>
 #include <Wt/WTextArea>
+#include <Wt/WGroupBox>
 #include <Wt/WLineEdit>
 #include <Wt/WDialog>
 #include <Wt/WMessageBox>
@@ -19,6 +22,11 @@
 #include "settings.h"
 #include "translation.h"
 #include "userlist.h"
+#include "journal.h"
+#include "postindex.h"
+#include "activity.h"
+#include "rendercache.h"
+#include "preview.h"
 
 lightforums::postPath::postPath(std::shared_ptr<post> from) {
 	std::shared_ptr<post> iter = from;
@@ -41,7 +49,7 @@ lightforums::postPath::postPath(std::shared_ptr<post> from) {
 			if (!zero) {
 				result.push_back(got);
 			}
-			if (got == 0 && j == 0) {
+			if (got == 0 && j == 0 && zero) { // The number is zero
 				result.push_back(0);
 			}
 		}
@@ -53,13 +61,22 @@ lightforums::postPath::postPath(std::shared_ptr<post> from) {
 	}
 }
 
-lightforums::post::post(std::shared_ptr<post> parent)
+lightforums::post::post(std::shared_ptr<post> parent) :
+	createdAt_(0),
+	uid_(0),
+	dirty_(false),
+	nextChildId_(0)
 {
 	setParent(parent);
 	setRatings();
 }
 
-lightforums::post::post(std::shared_ptr<post> parent, rapidxml::xml_node<>* node) {
+lightforums::post::post(std::shared_ptr<post> parent, rapidxml::xml_node<>* node, bool withChildren) :
+	createdAt_(0),
+	uid_(0),
+	dirty_(false),
+	nextChildId_(0)
+{
 	if (parent != nullptr) parent_ = parent;
 	else parent_ = std::shared_ptr<post>(this);
 	auto getAttribute = [&] (const char* attr) -> const char* {
@@ -67,7 +84,7 @@ lightforums::post::post(std::shared_ptr<post> parent, rapidxml::xml_node<>* node
 		if (!got) return "";
 		else return got->value();
 	};
-	title_ = std::make_shared<std::string>(getAttribute("title"));
+	title_ = std::make_shared<postText>(getAttribute("title"));
 	author_ = std::make_shared<std::string>(getAttribute("author"));
 	visibility_ = (rank)atoi(getAttribute("visibility"));
 	postedAt_ = (time_t)atoi(getAttribute("posted_at"));
@@ -75,10 +92,11 @@ lightforums::post::post(std::shared_ptr<post> parent, rapidxml::xml_node<>* node
 	lastActivity_.store(postedAt_);
 	sortBy_ = (sortPosts)atoi(getAttribute("sort_by"));
 	rapidxml::xml_node<>* textNode = node->first_node("text");
-	if (textNode) text_ = std::make_shared<std::string>(textNode->value());
-	else text_ = std::make_shared<std::string>("");
+	text_ = renderCache::get().compiled(std::make_shared<postText>(textNode ? textNode->value() : ""));
 	id_ = atoi(getAttribute("id"));
 	depth_ = atoi(getAttribute("depth"));
+	nextChildId_ = atoi(getAttribute("next_child")); // Missing in older saves, children raise it anyway
+	uid_ = strtoull(getAttribute("uid"), nullptr, 10); // Also missing in older saves, see postIndex::assignMissing
 	for (rapidxml::xml_node<>* files = node->first_node("file"); files; files = files->next_sibling("file")) {
 		rapidxml::xml_attribute<>* systemName = files->first_attribute("system");
 		rapidxml::xml_attribute<>* userName = files->first_attribute("user");
@@ -87,20 +105,38 @@ lightforums::post::post(std::shared_ptr<post> parent, rapidxml::xml_node<>* node
 			files_->push_back(std::make_pair(atoi(systemName->value()), std::string(userName->value())));
 		}
 	}
-	if (parent_.get() != this) parent->children_.insert(std::make_pair(id_, std::shared_ptr<post>(this)));
-
-	// Update post time of all posts this one replied to
-	std::shared_ptr<post> ancestor = parent_;
-	do {
-		ancestor->lastActivity_ .store(postedAt_);
-		ancestor = ancestor->parent_;
-	} while (ancestor->parent_ != ancestor);
+	if (parent_.get() != this) {
+		std::shared_ptr<post> made(this);
+		parent->children_.insert(std::make_pair(id_, made));
+		parent->reserveChildId(id_);
+		parent->order_.added(made);
+	}
 
 	// Deal with descendants
-	for (rapidxml::xml_node<>* child = node->first_node("post"); child; child = child->next_sibling()) {
+	if (withChildren) for (rapidxml::xml_node<>* child = node->first_node("post"); child; child = child->next_sibling("post")) {
 		new lightforums::post(self(), child);
 	}
 	setRatings();
+	if (uid_) postIndex::get().add(self());
+}
+
+time_t lightforums::post::updateActivity() {
+	time_t newest = postedAt_;
+	for (auto it = children_.begin(); it != children_.end(); it++) {
+		time_t got = it->second->updateActivity();
+		if (got > newest) newest = got;
+	}
+	lastActivity_.store(newest);
+	return newest;
+}
+
+void lightforums::post::setActivity(time_t at) {
+	lastActivity_.store(at);
+	orderChanged();
+}
+
+void lightforums::post::orderChanged() {
+	if (parent_.get() != this) parent_->order_.changed(this);
 }
 
 lightforums::post::~post()
@@ -125,53 +161,148 @@ void lightforums::post::setParent(std::shared_ptr<post> parent) {
 	} else {
 		unsigned int freeId;
 		do {
-			freeId = 0;
-			for (auto it = parent->children_.begin(); it != parent->children_.end(); ++it) {
-				if (it->first >= freeId) freeId = it->first + 1;
-			}
-		} while (!parent->children_.insert(std::make_pair(freeId, parent_)));
+			freeId = parent->nextChildId_++;
+		} while (!parent->children_.insert(std::make_pair(freeId, parent_))); // Only if placed with a given id
 		parent_ = parent;
 		id_ = freeId;
+		if (!uid_) uid_ = postIndex::get().allocate();
+		postIndex::get().add(self());
+		parent->order_.added(self());
+		markDirty();
 	}
 }
 
-rapidxml::xml_node<>* lightforums::post::getNode(rapidxml::xml_document<>* doc, std::vector<std::shared_ptr<std::string>>& strings) {
-	auto saveString = [&] (const char* key, std::shared_ptr<std::string> saved) -> rapidxml::xml_attribute<>* {
-		strings.push_back(saved);
-		return doc->allocate_attribute(key, saved->c_str());
-	};
-	auto saveNumber = [&] (const char* key, auto saved) -> rapidxml::xml_attribute<>* {
-		std::shared_ptr<std::string> made = std::make_shared<std::string>(std::to_string(saved));
-		strings.push_back(made);
-		return doc->allocate_attribute(key, made->c_str());
-	};
-	rapidxml::xml_node<>* made = doc->allocate_node(rapidxml::node_element, "post");
-	made->append_attribute(saveString("title", title_));
-	made->append_attribute(saveString("author", author_));
-	if (pin_) made->append_attribute(saveString("pin", pin_));
-	made->append_attribute(saveNumber("id", id_));
-	made->append_attribute(saveNumber("visibility", visibility_.load()));
-	made->append_attribute(saveNumber("depth", depth_.load()));
-	made->append_attribute(saveNumber("posted_at", postedAt_.load()));
-	made->append_attribute(saveNumber("sort_by", sortBy_));
-	doc->allocate_node(rapidxml::node_element, "text", text_->c_str());
-	std::shared_ptr<std::string> text(text_); // We don't want it to change while being saved
-	made->append_node(doc->allocate_node(rapidxml::node_element, "text", text->c_str()));
-	if (files_) {
-		std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files = files_; // Local copy
+bool lightforums::post::placeAt(std::shared_ptr<post> parent, unsigned int id) {
+	if (!parent->children_.insert(std::make_pair(id, parent_))) return false;
+	parent->reserveChildId(id);
+	parent_ = parent;
+	id_ = id;
+	if (uid_) postIndex::get().add(self());
+	parent->order_.added(self());
+	return true;
+}
+
+void lightforums::post::discard() {
+	// Children point to their parents and parents keep their children, so the links are broken from the bottom
+	std::vector<unsigned int> ids;
+	for (auto it = children_.begin(); it != children_.end(); it++) {
+		it->second->discard();
+		ids.push_back(it->first);
+	}
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		order_.removed(ids[i]);
+		children_.erase(ids[i]);
+	}
+	std::shared_ptr<post> parent;
+	parent.swap(parent_); // If it owns itself, it's freed once this returns
+}
+
+void lightforums::post::reserveChildId(unsigned int id) {
+	unsigned int next = nextChildId_;
+	while (next <= id && !nextChildId_.compare_exchange_weak(next, id + 1)) { }
+}
+
+std::shared_ptr<lightforums::post> lightforums::post::find(const postPath& path) {
+	postPath::iterator it = path.getIterator();
+	if (!it.hasNext()) return nullptr;
+	it.getNext(); // It's this one
+	std::shared_ptr<post> cur = self();
+	while (it.hasNext()) {
+		auto found = cur->children_.find(it.getNext());
+		if (found == cur->children_.end()) return nullptr;
+		cur = found->second;
+	}
+	return cur;
+}
+
+void lightforums::post::readVersion(postVersion& into) {
+	into.title = std::atomic_load(&title_);
+	into.text = std::atomic_load(&text_);
+	into.author = std::atomic_load(&author_);
+	into.pin = std::atomic_load(&pin_);
+	into.files = std::atomic_load(&files_);
+	into.visibility = visibility_.load();
+	into.depth = depth_.load();
+	into.sortBy = sortBy_;
+}
+
+void lightforums::post::keepVersion(const epochs::writeScope& change) {
+	if (!epochs::get().snapshotsActive()) {
+		if (std::atomic_load(&history_)) std::atomic_store(&history_, std::shared_ptr<postVersion>()); // Nobody needs it any more
+		return;
+	}
+	std::shared_ptr<postVersion> kept = std::make_shared<postVersion>();
+	readVersion(*kept);
+	kept->replacedAt = change.epoch();
+	kept->older = std::atomic_load(&history_);
+	while (!std::atomic_compare_exchange_weak(&history_, &kept->older, kept));
+}
+
+std::shared_ptr<lightforums::postVersion> lightforums::post::versionAt(const epochs::snapshot& view) {
+	// The current state must be read first, a change puts the old state aside before changing anything
+	std::shared_ptr<postVersion> result = std::make_shared<postVersion>();
+	readVersion(*result);
+	for (std::shared_ptr<postVersion> it = std::atomic_load(&history_); it; it = it->older) {
+		if (view.sees(it->replacedAt)) break;
+		result = it; // Replaced after the snapshot was taken, the oldest one of these is what the snapshot sees
+	}
+	return result;
+}
+
+std::vector<std::shared_ptr<lightforums::post>> lightforums::post::childrenAt(const epochs::snapshot& view) {
+	// The current children must be read first, a removal retires the child before erasing it,
+	// so one that's missing from them is surely among the retired ones read afterwards
+	std::vector<std::shared_ptr<post>> current;
+	for (auto it = children_.begin(); it != children_.end(); it++) current.push_back(it->second);
+	std::vector<std::shared_ptr<post>> retired = epochs::get().retiredChildren(this, view);
+	std::vector<std::shared_ptr<post>> result;
+	for (unsigned int i = 0; i < current.size(); i++) {
+		if (std::find(retired.begin(), retired.end(), current[i]) != retired.end()) continue; // Would be there twice
+		if (view.sees(current[i]->createdAt_)) result.push_back(current[i]);
+	}
+	for (unsigned int i = 0; i < retired.size(); i++) {
+		if (view.sees(retired[i]->createdAt_)) result.push_back(retired[i]);
+	}
+	return result;
+}
+
+void lightforums::post::markDirty() {
+	// Only the top-level post of the thread, walking up just reads, so replies don't write to shared ancestors
+	post* thread = this;
+	while (thread->parent_.get() != thread && thread->parent_->parent_.get() != thread->parent_.get()) thread = thread->parent_.get();
+	if (!thread->dirty_.load()) thread->dirty_.store(true);
+}
+
+void lightforums::post::save(xmlWriter& out, const epochs::snapshot& view) {
+	out.startElement("post");
+	std::shared_ptr<postVersion> saved = versionAt(view);
+	out.attribute("title", saved->title->data(), saved->title->size());
+	out.attribute("author", *saved->author);
+	if (saved->pin) out.attribute("pin", *saved->pin);
+	out.numberAttribute("id", id_);
+	out.numberAttribute("uid", uid_);
+	out.numberAttribute("visibility", saved->visibility);
+	out.numberAttribute("depth", saved->depth);
+	out.numberAttribute("posted_at", postedAt_.load());
+	out.numberAttribute("sort_by", saved->sortBy);
+	if (nextChildId_) out.numberAttribute("next_child", nextChildId_.load());
+	out.startElement("text");
+	out.text(saved->text->data(), saved->text->size());
+	out.endElement();
+	std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files = saved->files;
+	if (files) {
 		for (unsigned int i = 0; i < files->size(); i++) {
-			std::shared_ptr<std::string> userName = std::make_shared<std::string>(files->operator [](i).second);
-			rapidxml::xml_node<>* madeFile = doc->allocate_node(rapidxml::node_element, "file");
-			madeFile->append_attribute(saveNumber("system", files->operator [](i).first));
-			madeFile->append_attribute(saveString("user", userName));
-			strings.push_back(userName);
-			made->append_node(madeFile);
+			out.startElement("file");
+			out.numberAttribute("system", files->operator [](i).first);
+			out.attribute("user", files->operator [](i).second);
+			out.endElement();
 		}
 	}
-	for (auto it = children_.begin(); it != children_.end(); it++) {
-		made->append_node(it->second->getNode(doc, strings));
+	std::vector<std::shared_ptr<post>> children = childrenAt(view);
+	for (unsigned int i = 0; i < children.size(); i++) {
+		children[i]->save(out, view);
 	}
-	return made;
+	out.endElement();
 }
 
 struct fileAddingEntry {
@@ -191,7 +322,7 @@ struct fileAddingEntry {
 void addUpload(Wt::WContainerWidget* uploadsContainer, std::shared_ptr<std::vector<fileAddingEntry>> files) {
 	files->push_back(fileAddingEntry());
 	files->back().container = new Wt::WContainerWidget(uploadsContainer);
-	Wt::WPushButton* button = new Wt::WPushButton(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_UPLOAD)), files->back().container);
+	Wt::WPushButton* button = new Wt::WPushButton(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_UPLOAD)), files->back().container);
 	files->back().button = button;
 	button->setDisabled(true);
 	Wt::WFileUpload* upload = new Wt::WFileUpload(files->back().container);
@@ -205,35 +336,35 @@ void addUpload(Wt::WContainerWidget* uploadsContainer, std::shared_ptr<std::vect
 		if (upload->empty()) {
 			*deleted = false;
 			text->setText(Wt::WString(""));
-			button->setText(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_DELETE)));
+			button->setText(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_DELETE)));
 			addUpload(uploadsContainer, files);
 			upload->upload();
 		} else {
 			*deleted = true;
-			text->setText(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_DELETED)));
-			button->setText(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_UPLOAD)));
+			text->setText(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_DELETED)));
+			button->setText(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_UPLOAD)));
 		}
 	}));
 	upload->changed().connect(std::bind( [=] {
 		button->setDisabled(false);
 	}));
 	upload->uploaded().connect(std::bind( [=] {
-		text->setText(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_UPLOADED)));
+		text->setText(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_UPLOADED)));
 	}));
 	upload->fileTooLarge().connect(std::bind( [=] {
-	   text->setText(Wt::WString(*lightforums::tr::get(lightforums::tr::FILE_TOO_LARGE)));
+	   text->setText(Wt::WString(lightforums::tr::get(lightforums::tr::FILE_TOO_LARGE)));
 	}));
 }
 
 Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf, std::shared_ptr<user> viewing, std::shared_ptr<user> author, bool edit, std::function<void ()> react) {
-	Wt::WDialog* dialog = new Wt::WDialog(Wt::WString(*tr::get(edit ? tr::EDIT_POST : tr::WRITE_A_REPLY)));
+	Wt::WDialog* dialog = new Wt::WDialog(Wt::WString(tr::get(edit ? tr::EDIT_POST : tr::WRITE_A_REPLY)));
 	dialog->setModal(false);
 	Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(dialog->contents());
 
 	Wt::WLineEdit* nameEdit = nullptr;
 	if ((viewing && viewing->rank_ == ADMIN) || !viewing) {
 		nameEdit = new Wt::WLineEdit(dialog->contents());
-		nameEdit->setPlaceholderText(Wt::WString(*tr::get(tr::USER_NAME)));
+		nameEdit->setPlaceholderText(Wt::WString(tr::get(tr::USER_NAME)));
 		if (edit)
 			nameEdit->setText(Wt::WString(*std::atomic_load(&ptrToSelf->author_)));
 		else if (viewing && viewing->rank_ == ADMIN)
@@ -242,21 +373,24 @@ Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf,
 	}
 
 	Wt::WLineEdit* titleEdit = new Wt::WLineEdit(dialog->contents());
-	titleEdit->setPlaceholderText(Wt::WString(*tr::get(tr::WRITE_POST_TITLE)));
-	if (edit) titleEdit->setText(Wt::WString(*std::atomic_load(&ptrToSelf->title_)));
-	else titleEdit->setText(Wt::WString(replaceVar(*tr::get(tr::REPLY_TITLE), 'X', *std::atomic_load(&ptrToSelf->title_))));
+	titleEdit->setPlaceholderText(Wt::WString(tr::get(tr::WRITE_POST_TITLE)));
+	if (edit) titleEdit->setText(Wt::WString(std::atomic_load(&ptrToSelf->title_)->str()));
+	else titleEdit->setText(Wt::WString(replaceVar(tr::get(tr::REPLY_TITLE), 'X', std::atomic_load(&ptrToSelf->title_)->str())));
 	layout->addWidget(titleEdit);
 	Wt::WTextArea* textArea = new Wt::WTextArea(dialog->contents());
-	if (edit) textArea->setText(Wt::WString(*std::atomic_load(&ptrToSelf->text_)));
+	if (edit) textArea->setText(Wt::WString(std::atomic_load(&ptrToSelf->text_)->str()));
 	textArea->setColumns(80);
 	textArea->setRows(5);
 	layout->addWidget(textArea);
+	Wt::WGroupBox* previewBox = new Wt::WGroupBox(Wt::WString(tr::get(tr::PREVIEW)), dialog->contents());
+	new markupPreview(textArea, previewBox);
+	layout->addWidget(previewBox);
 
 	Wt::WContainerWidget* extraStuff = new Wt::WContainerWidget(dialog->contents());
 	layout->addWidget(extraStuff);
 	Wt::WGridLayout* extraStuffLayout = new Wt::WGridLayout(extraStuff);
 	int extraStuffOrder = 0;
-	auto addExtraForm = [&] (Wt::WWidget* added, std::shared_ptr<const std::string> title = nullptr) {
+	auto addExtraForm = [&] (Wt::WWidget* added, const std::string* title = nullptr) {
 		if (title) {
 			Wt::WContainerWidget* couple = new Wt::WContainerWidget(extraStuff);
 			new Wt::WText(Wt::WString(*title), couple);
@@ -278,10 +412,10 @@ Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf,
 	Wt::WLineEdit* pinEdit = nullptr;
 	if (viewing && viewing->rank_ == ADMIN) {
 		pinEdit = new Wt::WLineEdit();
-		pinEdit->setPlaceholderText(Wt::WString(*tr::get(tr::WRITE_PIN_HERE)));
+		pinEdit->setPlaceholderText(Wt::WString(tr::get(tr::WRITE_PIN_HERE)));
 		std::shared_ptr<std::string> current = ptrToSelf->pin_;
 		if (current) pinEdit->setText(Wt::WString(*current));
-		addExtraForm(pinEdit, tr::get(tr::PIN));
+		addExtraForm(pinEdit, &tr::get(tr::PIN));
 	}
 
 	std::shared_ptr<std::vector<fileAddingEntry>> files = std::make_shared<std::vector<fileAddingEntry>>();
@@ -298,7 +432,7 @@ Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf,
 		for (unsigned int i = 0; i < files->size(); i++) {
 			files->operator[] (i).container = new Wt::WContainerWidget(uploadsContainer);
 			Wt::WContainerWidget* container = files->operator[] (i).container;
-			files->operator[] (i).button = new Wt::WPushButton(Wt::WString(*tr::get(tr::FILE_DELETE)), container);
+			files->operator[] (i).button = new Wt::WPushButton(Wt::WString(tr::get(tr::FILE_DELETE)), container);
 			std::shared_ptr<bool> deleted = files->operator[] (i).deleted;
 			files->operator[] (i).button->clicked().connect(std::bind([=] () {
 				*deleted = true;
@@ -315,9 +449,9 @@ Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf,
 	Wt::WContainerWidget* newButtonContainer = new Wt::WContainerWidget(dialog->contents());
 	layout->addWidget(newButtonContainer);
 	Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(newButtonContainer);
-	Wt::WPushButton* okButton = new Wt::WPushButton(Wt::WString(*tr::get(edit? tr::EDIT_POST : tr::WRITE_A_REPLY)), newButtonContainer);
+	Wt::WPushButton* okButton = new Wt::WPushButton(Wt::WString(tr::get(edit? tr::EDIT_POST : tr::WRITE_A_REPLY)), newButtonContainer);
 	okButton->setDefault(true);
-	Wt::WPushButton* cancelButton = new Wt::WPushButton(Wt::WString(*tr::get(edit ? tr::CANCEL_EDITING : tr::CANCEL_REPLYING)), newButtonContainer);
+	Wt::WPushButton* cancelButton = new Wt::WPushButton(Wt::WString(tr::get(edit ? tr::CANCEL_EDITING : tr::CANCEL_REPLYING)), newButtonContainer);
 	buttonLayout->addWidget(okButton);
 	buttonLayout->addWidget(cancelButton);
 	buttonLayout->addStretch(1);
@@ -347,71 +481,80 @@ Wt::WDialog* lightforums::post::makePostDialog(std::shared_ptr<post> ptrToSelf,
 				}
 			}
 		}
-		if (edit) {
-			if (nameEdit) {
-				const std::string& newAuthorName = nameEdit->text().toUTF8();
-				//if (!user::validateUsername(newAuthorName)) return;
-				if (author) {
-					author->posts_--;
-					for (unsigned int i = 0; i < (int)ratingSize; i++) {
-						author->rating_[i] -= ptrToSelf->rating_[i];
+		std::shared_ptr<post> replied;
+		{
+			epochs::writeScope change;
+			if (edit) {
+				ptrToSelf->keepVersion(change);
+				ptrToSelf->markDirty();
+				if (nameEdit) {
+					const std::string& newAuthorName = nameEdit->text().toUTF8();
+					//if (!user::validateUsername(newAuthorName)) return;
+					if (author) {
+						author->posts_--;
+						for (unsigned int i = 0; i < (int)ratingSize; i++) {
+							author->rating_[i] -= ptrToSelf->rating_[i];
+						}
+						std::atomic_store(&ptrToSelf->author_, std::make_shared<std::string>(newAuthorName));
+					} else std::atomic_store(&ptrToSelf->author_, std::make_shared<std::string>(newAuthorName.empty() ?
+																									newAuthorName : replaceVar(tr::get(tr::GUEST_NAME), 'X', newAuthorName)));
+					std::shared_ptr<user> newAuthor = userList::get().getUser(newAuthorName);
+					if (newAuthor) {
+						newAuthor->posts_++;
+						for (unsigned int i = 0; i < (int)ratingSize; i++) {
+							newAuthor->rating_[i] += ptrToSelf->rating_[i];
+						}
 					}
 					std::atomic_store(&ptrToSelf->author_, std::make_shared<std::string>(newAuthorName));
-				} else std::atomic_store(&ptrToSelf->author_, std::make_shared<std::string>(newAuthorName.empty() ?
-																								newAuthorName : replaceVar(*tr::get(tr::GUEST_NAME), 'X', newAuthorName)));
-				std::shared_ptr<user> newAuthor = userList::get().getUser(newAuthorName);
-				if (newAuthor) {
-					newAuthor->posts_++;
-					for (unsigned int i = 0; i < (int)ratingSize; i++) {
-						newAuthor->rating_[i] += ptrToSelf->rating_[i];
-					}
 				}
-				std::atomic_store(&ptrToSelf->author_, std::make_shared<std::string>(newAuthorName));
-			}
-			if (sortCombo) {
-				ptrToSelf->sortBy_ = (sortPosts)sortCombo->currentIndex();
-			}
-			if (pinEdit) {
-				const std::string& got = pinEdit->text().toUTF8();
-				if (got.empty())
-					ptrToSelf->pin_.reset();
-				else
-					std::atomic_store(&ptrToSelf->pin_, std::make_shared<std::string>(got));
-			}
-			std::shared_ptr<std::string> newText = std::make_shared<std::string>(textArea->text().toUTF8());
-			std::atomic_store(&ptrToSelf->title_, std::make_shared<std::string>(titleEdit->text().toUTF8()));
-			std::atomic_store(&ptrToSelf->text_, newText);
-			std::atomic_store(&ptrToSelf->files_, newFiles);
-		} else {
-			post* reply = new post();
-			reply->title_ = std::make_shared<std::string>(titleEdit->text().toUTF8());
-			if (viewing) {
-				reply->author_ = std::make_shared<std::string>(*viewing->name_);
-				viewing->posts_++;
+				if (sortCombo) {
+					ptrToSelf->sortBy_ = (sortPosts)sortCombo->currentIndex();
+				}
+				if (pinEdit) {
+					const std::string& got = pinEdit->text().toUTF8();
+					if (got.empty())
+						ptrToSelf->pin_.reset();
+					else
+						std::atomic_store(&ptrToSelf->pin_, std::make_shared<std::string>(got));
+					ptrToSelf->orderChanged();
+				}
+				std::shared_ptr<postText> newText = renderCache::get().compiled(std::make_shared<postText>(textArea->text().toUTF8()));
+				std::atomic_store(&ptrToSelf->title_, std::make_shared<postText>(titleEdit->text().toUTF8()));
+				std::atomic_store(&ptrToSelf->text_, newText);
+				std::atomic_store(&ptrToSelf->files_, newFiles);
+				journal::get().postEdited(ptrToSelf);
 			} else {
-				std::string nameGiven = nameEdit->text().toUTF8();
-				if (!user::validateUsername(nameGiven)) return;
-				reply->author_ = std::make_shared<std::string>(replaceVar(*tr::get(tr::GUEST_NAME), 'X', nameGiven));
-			}
-			reply->text_ = std::make_shared<std::string>(textArea->text().toUTF8());
-			reply->visibility_ = USER;
-			reply->depth_ = Settings::get().viewDepth;
-			reply->sortBy_ = Settings::get().sortBy;
-			reply->postedAt_ = time(nullptr);
-			reply->lastActivity_.store(reply->postedAt_);
-			reply->files_ = newFiles;
-			if (pinEdit) {
-				const std::string& got = pinEdit->text().toUTF8();
-				if (!got.empty())
-					reply->pin_ = std::make_shared<std::string>(got);
+				post* reply = new post();
+				reply->title_ = std::make_shared<postText>(titleEdit->text().toUTF8());
+				if (viewing) {
+					reply->author_ = std::make_shared<std::string>(*viewing->name_);
+					viewing->posts_++;
+				} else {
+					std::string nameGiven = nameEdit->text().toUTF8();
+					if (!user::validateUsername(nameGiven)) return;
+					reply->author_ = std::make_shared<std::string>(replaceVar(tr::get(tr::GUEST_NAME), 'X', nameGiven));
+				}
+				reply->text_ = renderCache::get().compiled(std::make_shared<postText>(textArea->text().toUTF8()));
+				reply->visibility_ = USER;
+				reply->depth_ = Settings::get().viewDepth;
+				reply->sortBy_ = Settings::get().sortBy;
+				reply->postedAt_ = time(nullptr);
+				reply->lastActivity_.store(reply->postedAt_);
+				reply->files_ = newFiles;
+				if (pinEdit) {
+					const std::string& got = pinEdit->text().toUTF8();
+					if (!got.empty())
+						reply->pin_ = std::make_shared<std::string>(got);
+				}
+				reply->createdAt_ = change.epoch();
+				reply->setParent(ptrToSelf);
+				activityPropagator::get().touched(ptrToSelf, reply->postedAt_);
+				replied = reply->self();
 			}
-			std::shared_ptr<post> ancestor = ptrToSelf;
-			do {
-				ancestor->lastActivity_.store(reply->postedAt_);
-				ancestor = ancestor->parent_;
-			} while (ancestor->parent_ != ancestor);
-			reply->setParent(ptrToSelf);
 		}
+		// Waiting for the disk with the change open would hold back every save until the sync is done
+		if (replied && !journal::get().postCreated(replied, Settings::get().durablePosts ? journal::WAIT_FOR_DURABLE : journal::FIRE_AND_FORGET))
+			messageBox(tr::get(tr::POST_NOT_DURABLE), tr::get(tr::POST_NOT_DURABLE_EXPLANATION));
 		react();
 		dialog->accept();
 	}));
@@ -452,8 +595,8 @@ Wt::WContainerWidget* lightforums::post::build(const std::string& viewer, int de
 	titleContainer->setStyleClass("lightforums-titlebar");
 	Wt::WHBoxLayout* titleLayout = new Wt::WHBoxLayout(titleContainer);
 	textLayout->addWidget(titleContainer);
-	std::string titleString(ptrToSelf->pin_ ? replaceVar(tr::get(tr::PINNED_AFFIX), 'X', *std::atomic_load(&title_)) : *std::atomic_load(&title_));
-	Wt::WAnchor* titleWidget = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" POST_PATH_PREFIX "/" + postPath(ptrToSelf).getString()), Wt::WString(titleString), textArea);
+	std::string titleString(ptrToSelf->pin_ ? replaceVar(tr::get(tr::PINNED_AFFIX), 'X', std::atomic_load(&title_)->str()) : std::atomic_load(&title_)->str());
+	Wt::WAnchor* titleWidget = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, ptrToSelf->getLink()), Wt::WString(titleString), textArea);
 	titleLayout->addWidget(titleWidget);
 	titleLayout->addStretch(1);
 
@@ -468,34 +611,40 @@ Wt::WContainerWidget* lightforums::post::build(const std::string& viewer, int de
 	Wt::WContainerWidget* text = new Wt::WContainerWidget(showChart ? nextToTextArea : textArea);
 
 	if (viewing && ((author == viewing && viewing->rank_ >= Settings::get().canEditOwn) || (viewing->rank_ > Settings::get().canEditOther && (!author || viewing->rank_ > author->rank_)) || viewing->rank_ == ADMIN)) {
-		Wt::WPushButton* editButton = new Wt::WPushButton(Wt::WString(*tr::get(tr::EDIT_POST)), titleContainer);
+		Wt::WPushButton* editButton = new Wt::WPushButton(Wt::WString(tr::get(tr::EDIT_POST)), titleContainer);
 		titleLayout->addWidget(editButton);
 		editButton->clicked().connect(std::bind([=] () {
 			Wt::WDialog* dialog = makePostDialog(ptrToSelf, viewing, author, true, [=] () -> void {
-				titleWidget->setText(Wt::WString(*std::atomic_load(&ptrToSelf->title_)));
+				titleWidget->setText(Wt::WString(std::atomic_load(&ptrToSelf->title_)->str()));
 				text->clear();
-				formatString(*std::atomic_load(&ptrToSelf->text_), text);
+				showRendered(*renderCache::get().get(std::atomic_load(&ptrToSelf->text_)), text);
 			});
 			dialog->show();
 		}));
 	}
 	if (viewing && ((author == viewing && viewing->rank_ >= Settings::get().canDeleteOwn) || (viewing->rank_ > Settings::get().canEditOther && (!author || viewing->rank_ > author->rank_)) || viewing->rank_ == ADMIN)) {
-		Wt::WPushButton* deleteButton = new Wt::WPushButton(Wt::WString(*tr::get(tr::DELETE_POST)), titleContainer);
+		Wt::WPushButton* deleteButton = new Wt::WPushButton(Wt::WString(tr::get(tr::DELETE_POST)), titleContainer);
 		titleLayout->addWidget(deleteButton);
 		deleteButton->clicked().connect(std::bind([=] () {
 
-			areYouSureBox(*tr::get(tr::DELETE_POST), *tr::get(tr::DO_DELETE_POST), [=] () -> void {
+			areYouSureBox(tr::get(tr::DELETE_POST), tr::get(tr::DO_DELETE_POST), [=] () -> void {
 				for (unsigned int i = 0; i < ptrToSelf->files_->size(); i++) {
 					system(std::string("rmdir -f " + *std::atomic_load(&Settings::get().uploadPath) + "/" + std::to_string(ptrToSelf->files_->operator [](i).first) + "/" + ptrToSelf->files_->operator [](i).second).c_str());
 				}
+				journal::get().postDeleted(ptrToSelf);
+				epochs::writeScope change;
+				epochs::get().retire(ptrToSelf->parent_, ptrToSelf, change.epoch());
+				ptrToSelf->parent_->markDirty();
 				ptrToSelf->parent_->children_.erase(ptrToSelf->id_);
+				ptrToSelf->parent_->order_.removed(ptrToSelf->id_);
+				postIndex::get().remove(ptrToSelf);
 				if (author) author->posts_--;
 				delete result;
 			});
 		}));
 	}
 
-	formatString(*std::atomic_load(&text_), text);
+	showRendered(*renderCache::get().get(std::atomic_load(&text_)), text);
 	if (showChart) nextToTextLayout->addWidget(text, 1);
 	else textLayout->addWidget(text, 1);
 
@@ -533,7 +682,7 @@ Wt::WContainerWidget* lightforums::post::build(const std::string& viewer, int de
 
 	if (showParentLink) {
 		Wt::WContainerWidget* outer = new Wt::WContainerWidget();
-		new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" POST_PATH_PREFIX "/" + postPath(parent_).getString()), Wt::WString(*lightforums::tr::get(lightforums::tr::GO_TO_PARENT)), outer);
+		new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, parent_->getLink()), Wt::WString(lightforums::tr::get(lightforums::tr::GO_TO_PARENT)), outer);
 		outer->addWidget(result);
 		result = outer;
 	}
@@ -542,20 +691,11 @@ Wt::WContainerWidget* lightforums::post::build(const std::string& viewer, int de
 }
 
 std::string lightforums::post::getLink() {
-	std::string address = "/" POST_PATH_PREFIX;
-	std::shared_ptr<post> iter = self();
-	std::vector<unsigned int> idRow;
-	while (iter->self() != iter->parent_) {
-		idRow.push_back(iter->id_);
-		iter = iter->parent_;
-	}
-	idRow.push_back(iter->id_);
-	for (unsigned int i = idRow.size() - 1; i < idRow.size(); i--)
-		address.append("/" + std::to_string(idRow[i]));
-	return address;
+	// Links by path keep working, but these don't break when the post is moved
+	return "/" POST_ID_PREFIX "/" + std::to_string(uid_);
 }
 
-void lightforums::post::showChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from, unsigned int depth) {
+void lightforums::post::showChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from, unsigned int depth, std::shared_ptr<childOrder::key> cursor, bool backwards) {
 	container->clear();
 	Wt::WVBoxLayout* layoutV = new Wt::WVBoxLayout(container);
 	Wt::WContainerWidget* buttonsContainer = new Wt::WContainerWidget(container);
@@ -571,7 +711,7 @@ void lightforums::post::showChildren(std::string viewer, Wt::WContainerWidget* c
 		return;
 	}
 
-	Wt::WPushButton* hideRepliesButton = new Wt::WPushButton(Wt::WString(replaceVar(*tr::get(tr::HIDE_REPLIES), 'X', from->children_.size())), buttonsContainer);
+	Wt::WPushButton* hideRepliesButton = new Wt::WPushButton(Wt::WString(replaceVar(tr::get(tr::HIDE_REPLIES), 'X', from->children_.size())), buttonsContainer);
 	layoutH->addWidget(hideRepliesButton);
 	Wt::WPushButton* replyButton = addReplyButton(tr::WRITE_A_REPLY, viewer, container, buttonsContainer, from);
 	layoutH->addWidget(replyButton);
@@ -587,45 +727,31 @@ void lightforums::post::showChildren(std::string viewer, Wt::WContainerWidget* c
 		layoutV->addWidget(replyArea);
 	};
 
-	if (from->sortBy_ == SORT_BY_ACTIVITY || from->sortBy_ == SORT_BY_POST_TIME) {
-		std::vector<std::shared_ptr<post>> posts;
-		for (auto it = from->children_.begin(); it != from->children_.end(); it++) posts.push_back(it->second);
-		if (from->sortBy_ == SORT_BY_ACTIVITY) {
-			std::sort(posts.begin(), posts.end(), [] (const std::shared_ptr<post>& a, const std::shared_ptr<post>& b) -> bool {
-				if (!a->pin_) {
-					if (!b->pin_) return a->lastActivity_ > b->lastActivity_;
-					else return false;
-				} else {
-					if (!b->pin_) return true;
-					else return *a->pin_ < *b->pin_;
-				}
-			});
-		} else {
-			std::sort(posts.begin(), posts.end(), [] (const std::shared_ptr<post>& a, const std::shared_ptr<post>& b) -> bool{
-				if (!a->pin_) {
-					if (!b->pin_) return a->postedAt_ > b->postedAt_;
-					else return false;
-				} else {
-					if (!b->pin_) return true;
-					else return *a->pin_ < *b->pin_;
-				}
-			});
-		}
-		for (unsigned int i = 0; i < posts.size(); i++) {
-			addChild(posts[i]);
-		}
-	} else if (from->sortBy_ == SORT_SOMEHOW) {
-		for (auto it = from->children_.begin(); it != from->children_.end(); it++) {
-			addChild(it->second);
-		}
+	auto addPageButton = [&] (tr::translatable title, const childOrder::key& at, bool towards) {
+		Wt::WPushButton* pageButton = new Wt::WPushButton(Wt::WString(tr::get(title)), container);
+		layoutV->addWidget(pageButton);
+		std::shared_ptr<childOrder::key> pageCursor = std::make_shared<childOrder::key>(at);
+		pageButton->clicked().connect(std::bind([=] () {
+			showChildren(viewer, container, from, depth, pageCursor, towards);
+		}));
+	};
+
+	unsigned int pageSize = Settings::get().pageSize;
+	if (!pageSize) pageSize = from->children_.size();
+	childOrder::page shown = from->order_.getPage(from.get(), from->sortBy_, cursor.get(), backwards, pageSize);
+	if (shown.keys.empty() && cursor) shown.keys.push_back(*cursor); // Everything behind it was deleted, allow going back
+	if (shown.before) addPageButton(tr::NEWER_REPLIES, shown.keys.front(), true);
+	for (unsigned int i = 0; i < shown.posts.size(); i++) {
+		addChild(shown.posts[i]);
 	}
+	if (shown.after) addPageButton(tr::OLDER_REPLIES, shown.keys.back(), false);
 }
 
 void lightforums::post::hideChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from) {
 	container->clear();
 	makeRatingCombo(viewer, container, from);
 	if (from->children_.size() > 0) {
-		Wt::WPushButton* showRepliesButton = new Wt::WPushButton(Wt::WString(replaceVar(*tr::get(tr::SHOW_REPLIES), 'X', from->children_.size())), container);
+		Wt::WPushButton* showRepliesButton = new Wt::WPushButton(Wt::WString(replaceVar(tr::get(tr::SHOW_REPLIES), 'X', from->children_.size())), container);
 		showRepliesButton->clicked().connect(std::bind([=] () {
 			showChildren(viewer, container, from, 1);
 		}));
@@ -635,7 +761,7 @@ void lightforums::post::hideChildren(std::string viewer, Wt::WContainerWidget* c
 }
 
 Wt::WPushButton* lightforums::post::addReplyButton(tr::translatable title, std::string viewer, Wt::WContainerWidget* container, Wt::WContainerWidget* buttonContainer, std::shared_ptr<post> from) {
-	Wt::WPushButton* replyButton = new Wt::WPushButton(Wt::WString(replaceVar(*tr::get(title), 'X', from->children_.size())), buttonContainer);
+	Wt::WPushButton* replyButton = new Wt::WPushButton(Wt::WString(replaceVar(tr::get(title), 'X', from->children_.size())), buttonContainer);
 	replyButton->clicked().connect(std::bind([=] () {
 		std::shared_ptr<user> poster = userList::get().getUser(viewer);
 		Wt::WDialog* dialog = makePostDialog(from, poster, nullptr, false, [=] () -> void {
@@ -651,13 +777,13 @@ Wt::WComboBox* lightforums::post::makeRatingCombo(std::string viewer, Wt::WConta
 	if (!viewing) return nullptr;
 	Wt::WComboBox* made = new Wt::WComboBox(container);
 	std::vector<rating> available;
-	auto ratingFound = viewing->ratings_.find(from);
+	auto ratingFound = viewing->ratings_.find(from->getUid());
 	for (unsigned int i = 0; i < (unsigned int)ratingSize; i++) if (Settings::get().canBeRated[i]) {
-		made->addItem(*tr::get((tr::translatable)(tr::RATE_USEFUL + i)));
+		made->addItem(tr::get((tr::translatable)(tr::RATE_USEFUL + i)));
 		available.push_back((rating)i);
 		if (ratingFound != viewing->ratings_.end() && ratingFound->second == i) made->setCurrentIndex(available.size() - 1);
 	}
-	made->addItem(*tr::get(tr::NOT_RATED_YET));
+	made->addItem(tr::get(tr::NOT_RATED_YET));
 	if (ratingFound == viewing->ratings_.end()) made->setCurrentIndex(available.size());
 	available.push_back(ratingSize);
 	made->changed().connect(std::bind([=] () {
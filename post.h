@@ -8,6 +8,8 @@
 #include "defines.h"
 #include "atomic_unordered_map.h"
 #include "translation.h"
+#include "epoch.h"
+#include "childorder.h"
 
 namespace lightforums {
 
@@ -32,7 +34,7 @@ namespace lightforums {
 					if (!zero) {
 						result.push_back(got);
 					}
-					if (got == 0 && i == 0) {
+					if (got == 0 && i == 0 && zero) { // The number is zero
 						result.push_back(0);
 					}
 				}
@@ -84,6 +86,7 @@ namespace lightforums {
 				return num;
 			}
 			friend class postPath;
+			friend class binarySnapshot;
 		};
 
 		iterator getIterator() const {
@@ -110,18 +113,61 @@ namespace lightforums {
 		friend class std::hash<postPath>;
 	};
 
+	class postText {
+		// Title or text of a post. Usually owns its contents, but posts loaded from a mapped snapshot point
+		// into the mapping and keep it alive, until they are edited and get a new postText.
+		// The contents are not null-terminated.
+		std::string owned_;
+		std::shared_ptr<const void> keeper_;
+		const char* data_;
+		size_t size_;
+		std::shared_ptr<const renderedText> rendered_; // See renderCache
+	public:
+		postText(const std::string& from) : owned_(from), data_(owned_.c_str()), size_(owned_.size()) {}
+		postText(std::shared_ptr<const void> keeper, const char* data, size_t size) : keeper_(keeper), data_(size ? data : ""), size_(size) {}
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+		std::string str() const { return std::string(data_, size_); }
+		bool isView() const { return (bool)keeper_; }
+
+		postText(const postText&) = delete;
+		void operator=(const postText&) = delete;
+
+		friend class renderCache;
+	};
+
+	struct postVersion {
+		// The changeable fields of a post, older states are kept for saves that started before a change
+		std::shared_ptr<postText> title;
+		std::shared_ptr<postText> text;
+		std::shared_ptr<std::string> author;
+		std::shared_ptr<std::string> pin;
+		std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files;
+		rank visibility;
+		unsigned int depth;
+		sortPosts sortBy;
+		uint64_t replacedAt; // Epoch of the change that replaced this state
+		std::shared_ptr<postVersion> older;
+	};
+
 	class post
 	{
 	public:
 		post(std::shared_ptr<post> parent = nullptr);
-		post(std::shared_ptr<post> parent, rapidxml::xml_node<char>* node);
+		post(std::shared_ptr<post> parent, rapidxml::xml_node<char>* node, bool withChildren = true); // Activity has to be updated afterwards
 		~post();
-		rapidxml::xml_node<char>* getNode(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings);
+		void save(xmlWriter& out, const epochs::snapshot& view);
 		Wt::WContainerWidget* build(const std::string& viewer, int depth, bool showParentLink = false);
 		void setParent(std::shared_ptr<post> parent = nullptr);
-
-		std::shared_ptr<std::string> title_;
-		std::shared_ptr<std::string> text_;
+		time_t updateActivity(); // Sets the activity of the whole subtree from the times of posting, returns it
+		void setActivity(time_t at);
+		void orderChanged(); // Call when the pin changes, so that the parent shows it at the right place
+		bool placeAt(std::shared_ptr<post> parent, unsigned int id); // Like setParent, but with a known id, fails if it's taken
+		void discard(); // Frees a post that couldn't be placed, with its subtree, take it out of postIndex first
+
+		std::shared_ptr<postText> title_;
+		std::shared_ptr<postText> text_;
 		std::shared_ptr<std::string> author_;
 		std::atomic<rank> visibility_;
 		std::atomic_uint depth_;
@@ -132,17 +178,29 @@ namespace lightforums {
 		std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files_;
 
 		std::shared_ptr<std::string> pin_;
+		uint64_t createdAt_; // Epoch, must be set before the post is placed
+
+		void keepVersion(const epochs::writeScope& change); // Call before changing any of the fields in postVersion
+		std::shared_ptr<postVersion> versionAt(const epochs::snapshot& view);
+		std::vector<std::shared_ptr<post>> childrenAt(const epochs::snapshot& view);
+
+		// Changed since the last save, saves rewrite whole threads, so the mark is kept only at the top-level post of the thread
+		void markDirty();
+		void clearDirty() { dirty_.store(false); }
+		bool isDirty() const { return dirty_.load(); }
 
 		atomic_unordered_map<unsigned int, std::shared_ptr<post>> children_;
 
 		unsigned int getId() { return id_; }
+		uint64_t getUid() const { return uid_; } // Global, see postIndex
 		std::shared_ptr<post> self();
 		std::string getLink();
 		std::shared_ptr<post> getParent() { return parent_; }
+		std::shared_ptr<post> find(const postPath& path); // The path starts with this post, nullptr if anything on it is missing
 
 	private:
 
-		static void showChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from, unsigned int depth);
+		static void showChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from, unsigned int depth, std::shared_ptr<childOrder::key> cursor = nullptr, bool backwards = false);
 		static void hideChildren(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from);
 		static void addReplyMenu(std::string viewer, Wt::WContainerWidget* container, std::shared_ptr<post> from);
 		static Wt::WPushButton* addReplyButton(tr::translatable title, std::string viewer, Wt::WContainerWidget* container, Wt::WContainerWidget* buttonContainer, std::shared_ptr<post> from);
@@ -151,9 +209,19 @@ namespace lightforums {
 
 		std::shared_ptr<post> parent_;
 		unsigned long int id_;
+		uint64_t uid_;
+		std::shared_ptr<postVersion> history_; // Newest first
+		std::atomic_bool dirty_;
+		std::atomic_uint nextChildId_; // Ids are never reused, not even ids of deleted children
+		childOrder order_;
 		void setRatings();
+		void reserveChildId(unsigned int id); // Makes sure the id won't be given to a new child
+		void readVersion(postVersion& into);
 
 		friend class postPath;
+		friend class binarySnapshot;
+		friend class postIndex;
+		friend class journal;
 	};
 
 }
@@ -0,0 +1,50 @@
+#include "postindex.h"
+
+#include <vector>
+#include <algorithm>
+#include "post.h"
+
+lightforums::postIndex::postIndex() :
+	next_(1) // Zero means none yet
+{
+}
+
+void lightforums::postIndex::add(std::shared_ptr<post> added) {
+	uint64_t id = added->getUid();
+	if (!id) return;
+	posts_.insert(id, added);
+	uint64_t next = next_;
+	while (next <= id && !next_.compare_exchange_weak(next, id + 1)) { }
+}
+
+void lightforums::postIndex::addSubtree(std::shared_ptr<post> added) {
+	add(added);
+	for (auto it = added->children_.begin(); it != added->children_.end(); it++) addSubtree(it->second);
+}
+
+void lightforums::postIndex::remove(std::shared_ptr<post> removed) {
+	for (auto it = removed->children_.begin(); it != removed->children_.end(); it++) remove(it->second);
+	if (!removed->getUid()) return;
+	// A post dropped while loading can have the same id as the one that was kept, that one stays
+	auto found = posts_.find(removed->getUid());
+	if (found != posts_.end() && found->second == removed) posts_.erase(removed->getUid());
+}
+
+std::shared_ptr<lightforums::post> lightforums::postIndex::find(uint64_t id) {
+	auto found = posts_.find(id);
+	if (found == posts_.end()) return nullptr;
+	return found->second;
+}
+
+void lightforums::postIndex::assignMissing(std::shared_ptr<post> from) {
+	if (!from->uid_) {
+		from->uid_ = allocate();
+		add(from);
+	}
+	std::vector<std::pair<unsigned int, std::shared_ptr<post>>> children;
+	for (auto it = from->children_.begin(); it != from->children_.end(); it++) children.push_back(*it);
+	std::sort(children.begin(), children.end(), [] (const std::pair<unsigned int, std::shared_ptr<post>>& a, const std::pair<unsigned int, std::shared_ptr<post>>& b) {
+		return a.first < b.first;
+	});
+	for (unsigned int i = 0; i < children.size(); i++) assignMissing(children[i].second);
+}
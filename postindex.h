@@ -0,0 +1,43 @@
+#ifndef POSTINDEX_H
+#define POSTINDEX_H
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "atomic_unordered_map.h"
+
+namespace lightforums {
+
+	class post;
+
+	class postIndex {
+		// Every post by its global id. Unlike a path, the id stays the same for the whole life of the post,
+		// even if it's moved elsewhere, so ratings and links refer to posts by it. Ids are never reused.
+		// Posts loaded from saves made before the ids were added get them in tree order when everything is loaded.
+	public:
+		static inline postIndex& get() {
+			static postIndex holder;
+			return holder;
+		}
+
+		uint64_t allocate() { return next_++; }
+		void add(std::shared_ptr<post> added); // The post must have its id already
+		void addSubtree(std::shared_ptr<post> added);
+		void remove(std::shared_ptr<post> removed); // Removes the whole subtree
+		std::shared_ptr<post> find(uint64_t id);
+		void assignMissing(std::shared_ptr<post> from); // Gives ids to loaded posts that have none, in the same order every time
+		unsigned long int size() { return posts_.size(); }
+
+	private:
+		postIndex();
+
+		atomic_unordered_map<uint64_t, std::shared_ptr<post>> posts_;
+		std::atomic<uint64_t> next_;
+
+		postIndex(const postIndex&) = delete;
+		void operator=(const postIndex&) = delete;
+	};
+
+}
+
+#endif // POSTINDEX_H
@@ -0,0 +1,89 @@
+#include "preview.h"
+#include <algorithm>
+#include <Wt/WTextArea>
+#include <Wt/WTimer>
+#include "defines.h"
+
+#define PREVIEW_DELAY 400 // Milliseconds without typing before the preview is updated
+#define PREVIEW_BUDGET 16384 // Bytes rendered at once, if there's more, the rest is done after a pause
+#define PREVIEW_PAUSE 50
+
+lightforums::markupPreview::markupPreview(Wt::WTextArea* source, Wt::WContainerWidget* parent) :
+	Wt::WContainerWidget(parent),
+	source_(source),
+	due_(this, "previewDue")
+{
+	more_ = new Wt::WTimer(this);
+	more_->setSingleShot(true);
+	more_->setInterval(PREVIEW_PAUSE);
+	more_->timeout().connect(std::bind([=] () {
+		renderSome();
+	}));
+	due_.connect(std::bind([=] () {
+		update();
+	}));
+
+	// Waiting is done in the browser, otherwise every key would be a request
+	std::string wait = "function(o, e) { clearTimeout(o.lfPreview); o.lfPreview = setTimeout(function() { "
+			+ due_.createCall() + "; }, " + std::to_string(PREVIEW_DELAY) + "); }";
+	source_->keyWentUp().connect(wait);
+	source_->changed().connect(wait);
+	update();
+}
+
+void lightforums::markupPreview::update() {
+	std::string text = source_->text().toUTF8();
+	std::vector<std::string> split;
+	for (size_t from = 0; from < text.size(); ) {
+		size_t end = text.find("\n\n", from);
+		if (end == std::string::npos) end = text.size();
+		else end = std::min(text.find_first_not_of('\n', end), text.size()); // The empty lines belong to the one before
+		// A paragraph longer than the budget would be rendered at once, it's cut at a line break or at the budget
+		while (end - from > PREVIEW_BUDGET) {
+			size_t cut = text.rfind('\n', from + PREVIEW_BUDGET - 1);
+			if (cut != std::string::npos && cut >= from) cut++;
+			else {
+				cut = from + PREVIEW_BUDGET;
+				while (cut > from && (text[cut] & 0xc0) == 0x80) cut--; // Not inside a character
+				if (cut == from) cut = from + PREVIEW_BUDGET;
+			}
+			split.push_back(text.substr(from, cut - from));
+			from = cut;
+		}
+		split.push_back(text.substr(from, end - from));
+		from = end;
+	}
+
+	// Paragraphs that are the same at the start and at the end are kept as they are
+	size_t same = 0;
+	while (same < split.size() && same < paragraphs_.size() && split[same] == paragraphs_[same].text) same++;
+	size_t sameAtEnd = 0;
+	while (sameAtEnd < split.size() - same && sameAtEnd < paragraphs_.size() - same
+			&& split[split.size() - 1 - sameAtEnd] == paragraphs_[paragraphs_.size() - 1 - sameAtEnd].text) sameAtEnd++;
+
+	for (size_t i = same; i < paragraphs_.size() - sameAtEnd; i++) delete paragraphs_[i].shown;
+	paragraphs_.erase(paragraphs_.begin() + same, paragraphs_.end() - sameAtEnd);
+	std::vector<paragraph> changed;
+	for (size_t i = same; i < split.size() - sameAtEnd; i++) {
+		Wt::WContainerWidget* shown = new Wt::WContainerWidget();
+		insertWidget(i, shown);
+		changed.push_back(paragraph{std::move(split[i]), shown, false});
+	}
+	paragraphs_.insert(paragraphs_.begin() + same, changed.begin(), changed.end());
+	renderSome();
+}
+
+void lightforums::markupPreview::renderSome() {
+	more_->stop();
+	size_t budget = PREVIEW_BUDGET;
+	for (paragraph& part : paragraphs_) {
+		if (part.rendered) continue;
+		if (!budget) {
+			more_->start();
+			return;
+		}
+		formatString(part.text, part.shown);
+		part.rendered = true;
+		budget -= std::min(budget, part.text.size());
+	}
+}
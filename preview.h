@@ -0,0 +1,43 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <string>
+#include <vector>
+#include <Wt/WContainerWidget>
+#include <Wt/WJavaScript>
+
+namespace Wt {
+	class WTextArea;
+	class WTimer;
+}
+
+namespace lightforums {
+
+	class markupPreview : public Wt::WContainerWidget {
+		// Shows how the text being written will look. The browser waits until the author stops typing
+		// before asking for an update, only the paragraphs (parts between empty lines) that changed are
+		// rendered again and a long paste is rendered a bit at a time, so it never holds the session long.
+		// Paragraphs longer than what is rendered at once are cut into parts, at line breaks if possible.
+		// Markup spanning an empty line or a cut is shown per part, the posted text may differ there.
+	public:
+		markupPreview(Wt::WTextArea* source, Wt::WContainerWidget* parent = nullptr);
+
+	private:
+		struct paragraph {
+			std::string text;
+			Wt::WContainerWidget* shown;
+			bool rendered;
+		};
+
+		void update();
+		void renderSome();
+
+		Wt::WTextArea* source_;
+		Wt::JSignal<> due_;
+		Wt::WTimer* more_;
+		std::vector<paragraph> paragraphs_;
+	};
+
+}
+
+#endif // PREVIEW_H
@@ -0,0 +1,131 @@
+#include "rendercache.h"
+#include "defines.h"
+#include "post.h"
+#include "escape.h"
+
+namespace {
+
+	void appendEscaped(const char* text, size_t size, std::string& into) {
+		const char* end = text + size;
+		const char* plain = text; // Start of the part that needs no escaping
+		for (const char* at = text; at < end; at++) {
+			at += lightforums::escaper::findSpecial(at, end - at, lightforums::escaper::XML_SPECIAL);
+			if (at == end) break;
+			const char* entity;
+			switch (*at) {
+				case '<': entity = "&lt;"; break;
+				case '>': entity = "&gt;"; break;
+				case '&': entity = "&#38;"; break;
+				case '"': entity = "&#34;"; break;
+				case '\'': entity = "&#39;"; break;
+				default: continue;
+			}
+			into.append(plain, at - plain);
+			into.append(entity);
+			plain = at + 1;
+		}
+		into.append(plain, end - plain);
+	}
+
+}
+
+void lightforums::renderedText::addHtml(const std::string& html) {
+	if (html.empty()) return;
+	if (!ops.empty() && ops.back().type == HTML) ops.back().size += html.size();
+	else ops.push_back(op{HTML, uint32_t(bytes.size()), uint32_t(html.size()), 0});
+	bytes.append(html);
+}
+
+void lightforums::renderedText::addLink(const std::string& html, const char* path, size_t pathSize) {
+	ops.push_back(op{LINK, uint32_t(bytes.size()), uint32_t(html.size()), uint32_t(pathSize)});
+	bytes.append(html);
+	bytes.append(path, pathSize);
+}
+
+void lightforums::renderedText::addSpoiler(bool start) {
+	ops.push_back(op{start ? SPOILER_START : SPOILER_END, uint32_t(bytes.size()), 0, 0});
+}
+
+void lightforums::renderedText::wholeHtml(const std::string& spoilerTitle, std::string& into) const {
+	// Spoilers are details elements, the browser opens and closes them without asking the server
+	into.reserve(into.size() + bytes.size() + ops.size() * 16);
+	for (unsigned int i = 0; i < ops.size(); i++) {
+		const op& shown = ops[i];
+		if (shown.type == HTML) {
+			into.append(bytes, shown.start, shown.size);
+		} else if (shown.type == LINK) {
+			into += "<a href=\"";
+			appendEscaped(bytes.data() + shown.start + shown.size, shown.pathSize, into);
+			into += "\">";
+			into.append(bytes, shown.start, shown.size);
+			into += "</a>";
+		} else if (shown.type == SPOILER_START) {
+			into += "<details><summary>";
+			appendEscaped(spoilerTitle.data(), spoilerTitle.size(), into);
+			into += "</summary>";
+		} else if (shown.type == SPOILER_END) {
+			into += "</details>";
+		}
+	}
+}
+
+size_t lightforums::renderedText::memoryUsed() const {
+	// Short strings are stored inside and don't allocate anything
+	return sizeof(renderedText) + ops.capacity() * sizeof(op) + (bytes.capacity() > 15 ? bytes.capacity() + 1 : 0);
+}
+
+bool lightforums::renderString(const std::string& str, renderedText& into) {
+	return markupParser(str.data(), str.size()).parse(into);
+}
+
+lightforums::renderCache::renderCache() :
+	hits_(0),
+	misses_(0),
+	plain_(0),
+	entries_(0),
+	bytes_(0)
+{
+}
+
+std::shared_ptr<const lightforums::renderedText> lightforums::renderCache::get(const std::shared_ptr<postText>& text) {
+	std::shared_ptr<const renderedText> found = std::atomic_load(&text->rendered_);
+	if (found) {
+		hits_++;
+		return found;
+	}
+	misses_++;
+	renderedText* made = new renderedText();
+	if (!renderString(text->str(), *made)) plain_++;
+	made->ops.shrink_to_fit();
+	made->bytes.shrink_to_fit();
+	size_t size = made->memoryUsed();
+	entries_++;
+	bytes_ += size;
+	found = std::shared_ptr<const renderedText>(made, [this, size] (const renderedText* removed) {
+		entries_--;
+		bytes_ -= size;
+		delete removed;
+	});
+	// If two viewers rendered it at once, one of the results is simply dropped
+	std::atomic_store(&text->rendered_, found);
+	return found;
+}
+
+lightforums::renderCache::statistics lightforums::renderCache::getStatistics() const {
+	statistics result;
+	result.hits = hits_;
+	result.misses = misses_;
+	result.plain = plain_;
+	result.entries = entries_;
+	result.bytes = bytes_;
+	return result;
+}
+
+std::string lightforums::renderCache::describeStatistics() const {
+	statistics got = getStatistics();
+	std::string result = "Render cache: " + std::to_string(got.hits) + " hits, " + std::to_string(got.misses) + " misses";
+	if (got.hits + got.misses) result += " (" + std::to_string(got.hits * 100 / (got.hits + got.misses)) + "% hit rate)";
+	if (got.misses) result += ", " + std::to_string(got.plain * 100 / got.misses) + "% of the compiled texts had no markup";
+	result += ", " + std::to_string(got.entries) + " texts kept in " + std::to_string(got.bytes) + " bytes";
+	return result;
+}
@@ -0,0 +1,86 @@
+#ifndef RENDERCACHE_H
+#define RENDERCACHE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "markup.h"
+
+namespace lightforums {
+
+	class postText;
+
+	struct renderedText : public markupSink {
+		// Markup compiled into a flat list of operations over one buffer, showing it needs no parsing and
+		// adjacent text is a single widget. Styles and headings are already tags in the HTML of the text.
+		enum opType : unsigned char {
+			HTML,
+			LINK, // The HTML is the caption, the path follows it in the buffer
+			SPOILER_START,
+			SPOILER_END
+		};
+		struct op {
+			opType type;
+			uint32_t start;
+			uint32_t size;
+			uint32_t pathSize;
+		};
+		std::string bytes;
+		std::vector<op> ops;
+
+		void addHtml(const std::string& html) override; // Merges with the previous operation if it's also HTML
+		void addLink(const std::string& html, const char* path, size_t pathSize) override;
+		void addSpoiler(bool start) override;
+		inline std::string html(const op& of) const {
+			return bytes.substr(of.start, of.size);
+		}
+		inline std::string path(const op& of) const {
+			return bytes.substr(of.start + of.size, of.pathSize);
+		}
+		void wholeHtml(const std::string& spoilerTitle, std::string& into) const; // All of it as one piece of XHTML
+		size_t memoryUsed() const;
+	};
+
+	class renderCache {
+		// Every postText keeps its compiled form, made when it's created, edited or loaded. Edits make a new
+		// postText, so a stale compiled form can't be shown and goes away with the old text.
+	public:
+		static inline renderCache& get() {
+			static renderCache holder;
+			return holder;
+		}
+
+		struct statistics {
+			uint64_t hits;
+			uint64_t misses; // Texts compiled
+			uint64_t plain; // Of them, those without markup that skipped parsing
+			uint64_t entries; // Rendered forms kept now
+			uint64_t bytes;
+		};
+
+		std::shared_ptr<const renderedText> get(const std::shared_ptr<postText>& text); // Compiles it if it wasn't
+		inline std::shared_ptr<postText> compiled(std::shared_ptr<postText> text) {
+			get(text);
+			return text;
+		}
+		statistics getStatistics() const;
+		std::string describeStatistics() const;
+
+	private:
+		renderCache();
+
+		std::atomic_uint_fast64_t hits_;
+		std::atomic_uint_fast64_t misses_;
+		std::atomic_uint_fast64_t plain_;
+		std::atomic_uint_fast64_t entries_;
+		std::atomic_uint_fast64_t bytes_;
+
+		renderCache(const renderCache&) = delete;
+		void operator=(const renderCache&) = delete;
+	};
+
+}
+
+#endif // RENDERCACHE_H
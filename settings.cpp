@@ -1,6 +1,7 @@
 #include "settings.h"
 
 #include "rapidxml.hpp"
+#include "xmlwriter.h"
 #include <cstring>
 #include <iostream>
 #include <Wt/WCheckBox>
@@ -11,6 +12,7 @@
 #include <Wt/WGridLayout>
 #include <Wt/WLink>
 #include <Wt/WAnchor>
+#include "journal.h"
 
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 
@@ -73,14 +75,10 @@ void lightforums::Settings::setup(rapidxml::xml_node<>* from) {
 	if (from && from->first_node("file_order")) fileOrder.store(atoi(from->first_node("file_order")->value()));
 }
 
-rapidxml::xml_node<>* lightforums::Settings::save(rapidxml::xml_document<>* doc, std::vector<std::shared_ptr<std::string>>& strings) {
-	rapidxml::xml_node<>* made = doc->allocate_node(rapidxml::node_element, "settings");
+void lightforums::Settings::save(xmlWriter& out) {
+	out.startElement("settings");
 	auto appendNode = [&] (const char* field, const std::string& added) -> void {
-		std::shared_ptr<std::string> contents  = std::make_shared<std::string>(added);
-		std::shared_ptr<std::string> name  = std::make_shared<std::string>(field);
-		strings.push_back(contents);
-		strings.push_back(name);
-		made->append_node(doc->allocate_node(rapidxml::node_element, name->c_str(), contents->c_str()));
+		out.element(field, added);
 	};
 	std::function<void(bool&, bool, const char*, tr::translatable)> doOnBool = [&] (bool& target, bool preset, const char* field, tr::translatable description) {
 		appendNode(field, std::to_string(target));
@@ -92,7 +90,7 @@ rapidxml::xml_node<>* lightforums::Settings::save(rapidxml::xml_document<>* doc,
 		appendNode(field, std::to_string(target));
 	};
 	std::function<void(std::shared_ptr<std::string>&, const char*, const char*, tr::translatable)> doOnString = [&] (std::shared_ptr<std::string>& target, const char* preset, const char* field, tr::translatable description) {
-		appendNode(field, *target);
+		appendNode(field, *std::atomic_load(&target));
 	};
 	std::function<void(unsigned char*, unsigned char, const char*, tr::translatable, unsigned char, tr::translatable)> doOnEnum = [&] (unsigned char* target, unsigned char preset, const char* field, tr::translatable description, unsigned char elements, tr::translatable first) {
 		appendNode(field, std::to_string((int)*target));
@@ -100,7 +98,50 @@ rapidxml::xml_node<>* lightforums::Settings::save(rapidxml::xml_document<>* doc,
 	goThroughAll(doOnBool, doOnUint, doOnULint, doOnString, doOnEnum);
 
 	appendNode("file_order", std::to_string(fileOrder));
-	return made;
+	out.endElement();
+}
+
+std::string lightforums::Settings::getField(const std::string& field) {
+	std::string result;
+	std::function<void(bool&, bool, const char*, tr::translatable)> doOnBool = [&] (bool& target, bool preset, const char* name, tr::translatable description) {
+		if (field == name) result = std::to_string(target);
+	};
+	std::function<void(unsigned int&, unsigned int, const char*, tr::translatable)> doOnUint = [&] (unsigned int& target, unsigned int preset, const char* name, tr::translatable description) {
+		if (field == name) result = std::to_string(target);
+	};
+	std::function<void(unsigned long int&, unsigned long int, const char*, tr::translatable)> doOnULint = [&] (unsigned long int& target, unsigned long int preset, const char* name, tr::translatable description) {
+		if (field == name) result = std::to_string(target);
+	};
+	std::function<void(std::shared_ptr<std::string>&, const char*, const char*, tr::translatable)> doOnString = [&] (std::shared_ptr<std::string>& target, const char* preset, const char* name, tr::translatable description) {
+		if (field == name) result = *std::atomic_load(&target);
+	};
+	std::function<void(unsigned char*, unsigned char, const char*, tr::translatable, unsigned char, tr::translatable)> doOnEnum = [&] (unsigned char* target, unsigned char preset, const char* name, tr::translatable description, unsigned char elements, tr::translatable first) {
+		if (field == name) result = std::to_string((int)*target);
+	};
+	goThroughAll(doOnBool, doOnUint, doOnULint, doOnString, doOnEnum);
+	if (field == "file_order") result = std::to_string(fileOrder);
+	return result;
+}
+
+void lightforums::Settings::setField(const std::string& field, const std::string& value) {
+	std::function<void(bool&, bool, const char*, tr::translatable)> doOnBool = [&] (bool& target, bool preset, const char* name, tr::translatable description) {
+		if (field == name) target = (value == "1");
+	};
+	std::function<void(unsigned int&, unsigned int, const char*, tr::translatable)> doOnUint = [&] (unsigned int& target, unsigned int preset, const char* name, tr::translatable description) {
+		if (field == name) target = atoi(value.c_str());
+	};
+	std::function<void(unsigned long int&, unsigned long int, const char*, tr::translatable)> doOnULint = [&] (unsigned long int& target, unsigned long int preset, const char* name, tr::translatable description) {
+		if (field == name) target = atol(value.c_str());
+	};
+	std::function<void(std::shared_ptr<std::string>&, const char*, const char*, tr::translatable)> doOnString = [&] (std::shared_ptr<std::string>& target, const char* preset, const char* name, tr::translatable description) {
+		if (field == name) std::atomic_store(&target, std::make_shared<std::string>(value));
+	};
+	std::function<void(unsigned char*, unsigned char, const char*, tr::translatable, unsigned char, tr::translatable)> doOnEnum = [&] (unsigned char* target, unsigned char preset, const char* name, tr::translatable description, unsigned char elements, tr::translatable first) {
+		if (field != name) return;
+		*target = atoi(value.c_str());
+		if (*target >= elements) *target = preset;
+	};
+	goThroughAll(doOnBool, doOnUint, doOnULint, doOnString, doOnEnum);
 }
 
 Wt::WContainerWidget* lightforums::Settings::edit(const std::string& viewer) {
@@ -109,41 +150,48 @@ Wt::WContainerWidget* lightforums::Settings::edit(const std::string& viewer) {
 	int line = 0;
 
 	std::function<void(bool&, bool, const char*, tr::translatable)> doOnBool = [&] (bool& target, bool preset, const char* field, tr::translatable description) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(description)), result), line, 0);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(description)), result), line, 0);
 		Wt::WCheckBox* checkBox = new Wt::WCheckBox(result);
 		checkBox->setChecked(target);
 		grid->addWidget(checkBox, line, 1);
-		checkBox->checked().connect(std::bind([&] () {
+		std::string fieldName(field); // The original may not live long enough
+		checkBox->checked().connect(std::bind([&target, fieldName] () {
 			target = true;
+			journal::get().settingChanged(fieldName);
 		}));
-		checkBox->unChecked().connect(std::bind([&] () {
+		checkBox->unChecked().connect(std::bind([&target, fieldName] () {
 			target = false;
+			journal::get().settingChanged(fieldName);
 		}));
 		line++;
 	};
 	std::function<void(unsigned int&, unsigned int, const char*, tr::translatable)> doOnUint = [&] (unsigned int& target, unsigned int preset, const char* field, tr::translatable description) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(description)), result), line, 0);
-		grid->addWidget(makeEditableNumber(&target, result), line, 1);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(description)), result), line, 0);
+		std::string fieldName(field);
+		grid->addWidget(makeEditableNumber(&target, result, [fieldName] () { journal::get().settingChanged(fieldName); }), line, 1);
 		line++;
 	};
 	std::function<void(unsigned long int&, unsigned long int, const char*, tr::translatable)> doOnULint = [&] (unsigned long int& target, unsigned long int preset, const char* field, tr::translatable description) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(description)), result), line, 0);
-		grid->addWidget(makeEditableNumber(&target, result), line, 1);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(description)), result), line, 0);
+		std::string fieldName(field);
+		grid->addWidget(makeEditableNumber(&target, result, [fieldName] () { journal::get().settingChanged(fieldName); }), line, 1);
 		line++;
 	};
 	std::function<void(std::shared_ptr<std::string>&, const char*, const char*, tr::translatable)> doOnString = [&] (std::shared_ptr<std::string>& target, const char* preset, const char* field, tr::translatable description) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(description)), result), line, 0);
-		grid->addWidget(makeEditableText(&target, result), line, 1);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(description)), result), line, 0);
+		std::string fieldName(field);
+		grid->addWidget(makeEditableText(&target, result, [fieldName] () { journal::get().settingChanged(fieldName); }), line, 1);
 		line++;
 	};
 	std::function<void(unsigned char*, unsigned char, const char*, tr::translatable, unsigned char, tr::translatable)> doOnEnum = [&] (unsigned char* target, unsigned char preset, const char* field, tr::translatable description, unsigned char elements, tr::translatable first) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(description)), result), line, 0);
-		grid->addWidget(makeEnumEditor(target, elements, first, result), line, 1);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(description)), result), line, 0);
+		std::string fieldName(field);
+		grid->addWidget(makeEnumEditor(target, elements, first, result, [fieldName] () { journal::get().settingChanged(fieldName); }), line, 1);
 		line++;
 	};
 	goThroughAll(doOnBool, doOnUint, doOnULint, doOnString, doOnEnum);
 
-	Wt::WAnchor* showTranslation = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" TRANSLATION_PATH), Wt::WString(*lightforums::tr::get(lightforums::tr::CHANGE_TRANSLATION)), result);
+	Wt::WAnchor* showTranslation = new Wt::WAnchor(Wt::WLink(Wt::WLink::InternalPath, "/" TRANSLATION_PATH), Wt::WString(lightforums::tr::get(lightforums::tr::CHANGE_TRANSLATION)), result);
 	grid->addWidget(showTranslation, line, 0);
 
 	grid->setColumnStretch(1, 1);
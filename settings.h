@@ -16,8 +16,10 @@ namespace lightforums {
 		}
 
 		void setup(rapidxml::xml_node<char>* from = nullptr);
-		rapidxml::xml_node<char>* save(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings);
+		void save(xmlWriter& out);
 		Wt::WContainerWidget* edit(const std::string& viewer);
+		std::string getField(const std::string& field);
+		void setField(const std::string& field, const std::string& value);
 
 		enum howToDisplay {
 			SHOW_ALL,
@@ -26,8 +28,16 @@ namespace lightforums {
 			howToDisplaySize
 		};
 
+		enum saveFormat {
+			SAVE_XML,
+			SAVE_BINARY,
+			saveFormatSize
+		};
+
 		bool guestPosting;
 		unsigned int viewDepth;
+		unsigned int pageSize;
+		bool singleWidgetPosts;
 		rank canEditOwn;
 		rank canEditOther;
 		rank canDeleteOwn;
@@ -44,6 +54,9 @@ namespace lightforums {
 		sortPosts sortBy;
 		std::shared_ptr<std::string> downloadPath;
 		std::shared_ptr<std::string> uploadPath;
+		bool durablePosts;
+		unsigned int durableWindow;
+		saveFormat saveAs;
 		std::atomic_uint fileOrder;
 
 	private:
@@ -54,6 +67,8 @@ namespace lightforums {
 						  std::function<void(unsigned char*, unsigned char, const char*, tr::translatable, unsigned char, tr::translatable)> doOnEnum) {
 			doOnBool(guestPosting, true, "guest_posting", tr::SET_GUEST_POSTING);
 			doOnUint(viewDepth, 1, "view_depth", tr::SET_VIEW_DEPTH);
+			doOnUint(pageSize, 50, "page_size", tr::SET_PAGE_SIZE);
+			doOnBool(singleWidgetPosts, false, "single_widget_posts", tr::SET_SINGLE_WIDGET_POSTS);
 			doOnEnum((unsigned char*)&canEditOwn, USER, "can_edit_own", tr::SET_CAN_EDIT_OWN, rankSize, tr::RANK_USER);
 			doOnEnum((unsigned char*)&canDeleteOwn, USER, "can_delete_own", tr::SET_CAN_DELETE_OWN, rankSize, tr::RANK_USER);
 			doOnEnum((unsigned char*)&canEditOther, MODERATOR, "can_edit_other", tr::SET_CAN_EDIT_OTHER, rankSize, tr::RANK_USER);
@@ -74,8 +89,13 @@ namespace lightforums {
 			doOnEnum((unsigned char*)&sortBy, SORT_BY_ACTIVITY, "sort_posts_by", tr::SET_REPLIES_SORT, sortPostsSize, tr::REPLIES_SORT_SOMEHOW);
 			doOnString(downloadPath, ".", "download_path", tr::SET_DOWNLOAD_PATH);
 			doOnString(uploadPath, "0.0.0.0:8080/", "upload_path", tr::SET_UPLOAD_PATH);
+			doOnBool(durablePosts, false, "durable_posts", tr::SET_DURABLE_POSTS);
+			doOnUint(durableWindow, 2000, "durable_window", tr::SET_DURABLE_WINDOW);
+			doOnEnum((unsigned char*)&saveAs, SAVE_XML, "save_format", tr::SET_SAVE_FORMAT, saveFormatSize, tr::SAVE_FORMAT_XML);
 		}
 
+		friend class binarySnapshot;
+
 		Settings(const Settings&) = delete;
 		void operator=(const Settings&) = delete;
 	};
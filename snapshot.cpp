@@ -0,0 +1,530 @@
+#include "snapshot.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+#include <sys/stat.h>
+#include "binarystream.h"
+#include "mappedfile.h"
+#include "atomicfile.h"
+#include "postindex.h"
+#include "mainwindow.h"
+#include "userlist.h"
+#include "settings.h"
+#include "translation.h"
+#include "rendercache.h"
+
+class lightforums::binarySnapshot::stringTable {
+	std::unordered_map<std::string, uint64_t> ids_;
+	binaryWriter data_;
+public:
+	uint64_t get(const std::string& str) {
+		auto found = ids_.find(str);
+		if (found != ids_.end()) return found->second;
+		uint64_t id = ids_.size();
+		ids_.insert(std::make_pair(str, id));
+		data_.putString(str);
+		return id;
+	}
+	void write(binaryWriter& into) {
+		binaryWriter contents;
+		contents.putVarint(ids_.size());
+		contents.putRaw(data_.data().c_str(), data_.size());
+		into.putByte(SECTION_STRINGS);
+		into.putString(contents.data());
+	}
+};
+
+std::unordered_map<unsigned int, std::string> lightforums::binarySnapshot::segments_;
+std::unordered_map<unsigned int, std::string> lightforums::binarySnapshot::unloaded_;
+std::unordered_set<std::string> lightforums::binarySnapshot::previousFiles_;
+std::unordered_set<std::string> lightforums::binarySnapshot::olderFiles_;
+uint64_t lightforums::binarySnapshot::generation_ = 0;
+
+namespace lightforums {
+	static const std::string& getFromTable(const std::vector<std::string>& strings, uint64_t id) {
+		static const std::string nothing;
+		if (id >= strings.size()) return nothing;
+		return strings[id];
+	}
+
+	static std::vector<std::pair<std::string, std::string>> getCatalog(binaryReader& reader) {
+		std::vector<std::pair<std::string, std::string>> result;
+		uint64_t count = reader.getVarint();
+		for (uint64_t i = 0; i < count && !reader.failed(); i++) {
+			std::string original = reader.getString();
+			std::string translated = reader.getString();
+			result.push_back(std::make_pair(original, translated));
+		}
+		return result;
+	}
+}
+
+bool lightforums::binarySnapshot::recognise(const std::string& fileName) {
+	std::ifstream in(fileName, std::ios::binary);
+	if (!in.is_open()) return false;
+	char magic[sizeof(SNAPSHOT_MAGIC) - 1];
+	if (!in.read(magic, sizeof(magic))) return false;
+	return !memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic));
+}
+
+void lightforums::binarySnapshot::savePost(binaryWriter& writer, stringTable& strings, const epochs::snapshot& view, std::shared_ptr<post> saved, bool withChildren) {
+	std::shared_ptr<postVersion> version = saved->versionAt(view);
+	writer.putVarint(saved->getId());
+	writer.putString(version->title->data(), version->title->size());
+	writer.putVarint(strings.get(*version->author));
+	writer.putString(version->text->data(), version->text->size());
+	writer.putByte(version->visibility);
+	writer.putVarint(version->depth);
+	writer.putByte(version->sortBy);
+	writer.putVarint(saved->postedAt_);
+	std::shared_ptr<std::string> pin = version->pin;
+	std::shared_ptr<std::vector<std::pair<unsigned int, std::string>>> files = version->files;
+	unsigned int nextChildId = saved->nextChildId_;
+	uint64_t uid = saved->getUid();
+	writer.putByte((pin ? 0x1 : 0x0) | (files ? 0x2 : 0x0) | (nextChildId ? 0x4 : 0x0) | (uid ? 0x8 : 0x0));
+	if (pin) writer.putVarint(strings.get(*pin));
+	if (files) {
+		writer.putVarint(files->size());
+		for (unsigned int i = 0; i < files->size(); i++) {
+			writer.putVarint(files->operator [](i).first);
+			writer.putString(files->operator [](i).second);
+		}
+	}
+	if (nextChildId) writer.putVarint(nextChildId);
+	if (uid) writer.putVarint(uid);
+	if (!withChildren) {
+		writer.putVarint(0);
+		return;
+	}
+	std::vector<std::shared_ptr<post>> children = saved->childrenAt(view);
+	writer.putVarint(children.size());
+	for (unsigned int i = 0; i < children.size(); i++) savePost(writer, strings, view, children[i]);
+}
+
+bool lightforums::binarySnapshot::writeFile(const std::string& fileName, stringTable& strings, binaryWriter& sections, bool syncDirectory) {
+	binaryWriter header;
+	header.putRaw(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1);
+	header.putVarint(SNAPSHOT_VERSION);
+	strings.write(header); // Must be read before everything else
+	sections.putByte(SECTION_END);
+
+	atomicFile out;
+	if (!out.open(fileName)) return false;
+	if (!out.write(header.data().c_str(), header.size()) || !out.write(sections.data().c_str(), sections.size())) return false;
+	return out.commit(syncDirectory);
+}
+
+bool lightforums::binarySnapshot::saveThread(const std::string& fileName, const epochs::snapshot& view, std::shared_ptr<post> thread) {
+	stringTable strings;
+	binaryWriter posts;
+	savePost(posts, strings, view, thread);
+	binaryWriter sections;
+	sections.putByte(SECTION_POSTS);
+	sections.putString(posts.data());
+	return writeFile(fileName, strings, sections, false); // The main file syncs the directory after all of them are written
+}
+
+bool lightforums::binarySnapshot::save(const std::string& fileName) {
+	generation_++;
+	// Dirty flags are cleared before the snapshot is taken, anything changed afterwards will be dirty for the next save
+	std::shared_ptr<post> rootPost = root::get().getRootPost();
+	std::unordered_set<unsigned int> rewritten;
+	for (auto it = rootPost->children_.begin(); it != rootPost->children_.end(); it++) {
+		if (it->second->isDirty() || segments_.find(it->first) == segments_.end()) {
+			rewritten.insert(it->first);
+			it->second->clearDirty();
+		}
+	}
+	epochs::snapshot view;
+	stringTable strings;
+	binaryWriter sections;
+	auto closeSection = [&] (section type, binaryWriter& contents) {
+		sections.putByte(type);
+		sections.putString(contents.data());
+	};
+
+	binaryWriter settings;
+	std::vector<std::string> fields;
+	Settings& setting = Settings::get();
+	setting.goThroughAll([&] (bool&, bool, const char* field, tr::translatable) { fields.push_back(field); },
+						 [&] (unsigned int&, unsigned int, const char* field, tr::translatable) { fields.push_back(field); },
+						 [&] (unsigned long int&, unsigned long int, const char* field, tr::translatable) { fields.push_back(field); },
+						 [&] (std::shared_ptr<std::string>&, const char*, const char* field, tr::translatable) { fields.push_back(field); },
+						 [&] (unsigned char*, unsigned char, const char* field, tr::translatable, unsigned char, tr::translatable) { fields.push_back(field); });
+	fields.push_back("file_order");
+	settings.putVarint(fields.size());
+	for (unsigned int i = 0; i < fields.size(); i++) {
+		settings.putVarint(strings.get(fields[i]));
+		settings.putString(setting.getField(fields[i]));
+	}
+	closeSection(SECTION_SETTINGS, settings);
+
+	binaryWriter users;
+	std::vector<std::shared_ptr<user>> userList;
+	for (auto it = userList::get().users_.begin(); it != userList::get().users_.end(); it++) userList.push_back(it->second);
+	users.putVarint(userList.size());
+	for (unsigned int i = 0; i < userList.size(); i++) {
+		std::shared_ptr<user> saved = userList[i];
+		users.putVarint(strings.get(*std::atomic_load(&saved->name_)));
+		users.putString(*std::atomic_load(&saved->password_));
+		users.putString(*std::atomic_load(&saved->salt_));
+		users.putByte(saved->rank_);
+		std::shared_ptr<std::string> title = std::atomic_load(&saved->title_);
+		users.putByte(title ? 1 : 0);
+		if (title) users.putString(*title);
+		std::shared_ptr<std::string> description = std::atomic_load(&saved->description_);
+		users.putString(description ? *description : "");
+		std::vector<std::pair<uint64_t, rating>> ratings = saved->ratingsAt(view);
+		users.putVarint(ratings.size());
+		for (unsigned int j = 0; j < ratings.size(); j++) {
+			users.putVarint(ratings[j].first);
+			users.putByte(ratings[j].second);
+		}
+	}
+	closeSection(SECTION_USERS, users);
+
+	binaryWriter threads;
+	savePost(threads, strings, view, rootPost, false);
+	threads.putVarint(generation_);
+	std::vector<std::shared_ptr<post>> children = rootPost->childrenAt(view);
+	std::unordered_map<unsigned int, std::string> segments;
+	for (unsigned int i = 0; i < children.size(); i++) {
+		unsigned int id = children[i]->getId();
+		auto known = segments_.find(id);
+		if (known != segments_.end() && rewritten.find(id) == rewritten.end()) {
+			segments.insert(*known);
+			continue;
+		}
+		std::string segmentName = fileName + "." + std::to_string(id) + "." + std::to_string(generation_);
+		if (saveThread(segmentName, view, children[i])) {
+			segments.insert(std::make_pair(id, segmentName));
+		} else {
+			std::cerr << "Could not save thread " << id << " into " << segmentName << std::endl;
+			children[i]->markDirty();
+			if (known != segments_.end()) segments.insert(*known); // Outdated, but better than nothing
+		}
+	}
+	// Threads that couldn't be loaded keep their old files, so that they're tried again on the next start
+	for (auto it = unloaded_.begin(); it != unloaded_.end(); ) {
+		if (segments.find(it->first) != segments.end()) {
+			std::cerr << "Thread " << it->first << " was replaced, " << it->second << " is not kept any more" << std::endl;
+			it = unloaded_.erase(it);
+		} else {
+			std::cerr << "Thread " << it->first << " is not loaded, " << it->second << " is kept as it was" << std::endl;
+			it++;
+		}
+	}
+	threads.putVarint(segments.size() + unloaded_.size());
+	for (auto it = segments.begin(); it != segments.end(); it++) {
+		threads.putVarint(it->first);
+		threads.putString(it->second);
+	}
+	for (auto it = unloaded_.begin(); it != unloaded_.end(); it++) {
+		threads.putVarint(it->first);
+		threads.putString(it->second);
+	}
+	closeSection(SECTION_THREADS, threads);
+
+	tr& translator = tr::getInstance();
+	auto putCatalog = [&] (binaryWriter& into, const tr::catalog* saved) {
+		const tr::table* shown = saved->table_.load(std::memory_order_acquire);
+		std::vector<int> translated;
+		for (int i = 0; i < (int)tr::translatableMax; i++)
+			if (shown->translated[i]) translated.push_back(i);
+		into.putVarint(translated.size());
+		for (unsigned int i = 0; i < translated.size(); i++) {
+			into.putString(translator.original_[translated[i]]);
+			into.putString(shown->shown[translated[i]]);
+		}
+	};
+	binaryWriter translations;
+	binaryWriter locales;
+	{
+		std::lock_guard<std::mutex> lock(translator.editLock_);
+		putCatalog(translations, translator.default_);
+		locales.putVarint(translator.catalogs_.size() - 1);
+		for (unsigned int i = 0; i < translator.catalogs_.size(); i++) {
+			if (translator.catalogs_[i].get() == translator.default_) continue;
+			locales.putString(translator.catalogs_[i]->locale_);
+			putCatalog(locales, translator.catalogs_[i].get());
+		}
+	}
+	closeSection(SECTION_TRANSLATIONS, translations);
+	closeSection(SECTION_LOCALES, locales);
+
+	binaryWriter cookies;
+	std::vector<std::pair<std::string, std::string>> cookieList;
+	for (auto it = root::get().cookies_.begin(); it != root::get().cookies_.end(); it++) cookieList.push_back(std::make_pair(it->first, it->second));
+	cookies.putVarint(cookieList.size());
+	for (unsigned int i = 0; i < cookieList.size(); i++) {
+		cookies.putString(cookieList[i].first);
+		cookies.putVarint(strings.get(cookieList[i].second));
+	}
+	closeSection(SECTION_COOKIES, cookies);
+
+	if (!writeFile(fileName, strings, sections)) {
+		for (unsigned int i = 0; i < children.size(); i++) {
+			if (rewritten.find(children[i]->getId()) != rewritten.end()) children[i]->markDirty();
+		}
+		return false;
+	}
+
+	// Files of the previous save are kept for its file, which was moved aside, older ones can go
+	std::unordered_set<std::string> current;
+	for (auto it = segments.begin(); it != segments.end(); it++) current.insert(it->second);
+	for (auto it = unloaded_.begin(); it != unloaded_.end(); it++) current.insert(it->second);
+	for (auto it = olderFiles_.begin(); it != olderFiles_.end(); it++) {
+		if (previousFiles_.find(*it) == previousFiles_.end() && current.find(*it) == current.end()) remove(it->c_str());
+	}
+	olderFiles_ = previousFiles_;
+	previousFiles_ = current;
+	std::cerr << "Saved " << rewritten.size() << " changed threads of " << segments.size() << std::endl;
+	segments_ = segments;
+	return true;
+}
+
+std::shared_ptr<lightforums::post> lightforums::binarySnapshot::loadPost(binaryReader& reader, const std::vector<std::string>& strings, std::shared_ptr<mappedFile> source, std::shared_ptr<post> parent) {
+	auto getText = [&] () -> std::shared_ptr<postText> {
+		size_t size = reader.getVarint();
+		const char* got = reader.getRaw(size);
+		if (!got) return std::make_shared<postText>("");
+		if (source->mapped()) return std::make_shared<postText>(source, got, size);
+		return std::make_shared<postText>(std::string(got, size)); // A copy in memory would be kept whole as long as any post uses it
+	};
+	unsigned int id = reader.getVarint();
+	post* made = new post();
+	made->title_ = getText();
+	made->author_ = std::make_shared<std::string>(getFromTable(strings, reader.getVarint()));
+	made->text_ = renderCache::get().compiled(getText());
+	made->visibility_ = (rank)reader.getByte();
+	if (made->visibility_ >= rankSize) made->visibility_ = USER;
+	made->depth_ = reader.getVarint();
+	made->sortBy_ = (sortPosts)reader.getByte();
+	if (made->sortBy_ >= sortPostsSize) made->sortBy_ = SORT_SOMEHOW;
+	made->postedAt_ = reader.getVarint();
+	unsigned char flags = reader.getByte();
+	if (flags & 0x1) made->pin_ = std::make_shared<std::string>(getFromTable(strings, reader.getVarint()));
+	if (flags & 0x2) {
+		made->files_ = std::make_shared<std::vector<std::pair<unsigned int, std::string>>>();
+		unsigned int fileCount = reader.getVarint();
+		for (unsigned int i = 0; i < fileCount && !reader.failed(); i++) {
+			unsigned int systemName = reader.getVarint();
+			made->files_->push_back(std::make_pair(systemName, reader.getString()));
+		}
+	}
+	if (flags & 0x4) made->nextChildId_ = reader.getVarint();
+	if (flags & 0x8) made->uid_ = reader.getVarint();
+
+	// Without a parent, the post is left detached and it's up to the caller to place it
+	std::shared_ptr<post> self = made->self();
+	bool placed = true;
+	if (parent) {
+		placed = made->placeAt(parent, id); // A duplicate id means the file is damaged, the post is lost with its replies
+		if (!placed) made->id_ = id;
+	} else {
+		made->id_ = id;
+		if (made->uid_) postIndex::get().add(self);
+	}
+
+	// Activity is the time of the newest post in the subtree
+	time_t lastActivity = made->postedAt_;
+	unsigned int childCount = reader.getVarint();
+	for (unsigned int i = 0; i < childCount && !reader.failed(); i++) {
+		std::shared_ptr<post> child = loadPost(reader, strings, source, self);
+		if (child && child->lastActivity_ > lastActivity) lastActivity = child->lastActivity_;
+	}
+	if (!placed) {
+		// Its replies had to be read to get past them, now they go too
+		std::cerr << "Dropping post " << id << " of uid " << made->uid_ << ", its id is taken" << std::endl;
+		postIndex::get().remove(self);
+		made->discard();
+		return nullptr;
+	}
+	made->lastActivity_.store(lastActivity);
+	return self;
+}
+
+bool lightforums::binarySnapshot::readFile(std::shared_ptr<mappedFile> source, const std::string& fileName,
+											   std::function<void(section, binaryReader&, const std::vector<std::string>&)> onSection, uint64_t* versionRead) {
+	binaryReader reader(source->data(), source->size());
+	const char* magic = reader.getRaw(sizeof(SNAPSHOT_MAGIC) - 1);
+	if (!magic || memcmp(magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1)) return false;
+	uint64_t version = reader.getVarint();
+	if (versionRead) *versionRead = version;
+	if (version > SNAPSHOT_VERSION) {
+		std::cerr << fileName << " was saved by a newer version (" << version << "), can't read it" << std::endl;
+		return false;
+	}
+	atomicFile::checksumState checksum = atomicFile::verify(source->data(), source->size());
+	if (checksum == atomicFile::CHECKSUM_WRONG || (checksum == atomicFile::CHECKSUM_MISSING && version >= 3)) {
+		std::cerr << fileName << " is damaged or incomplete" << std::endl;
+		return false;
+	}
+
+	std::vector<std::string> strings;
+	while (!reader.failed()) {
+		section type = (section)reader.getByte();
+		if (type == SECTION_END) break;
+		size_t size = reader.getVarint();
+		const char* contents = reader.getRaw(size);
+		if (!contents) break;
+		binaryReader sectionReader(contents, size);
+		if (type == SECTION_STRINGS) {
+			uint64_t count = sectionReader.getVarint();
+			strings.reserve(count);
+			for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) strings.push_back(sectionReader.getString());
+		} else onSection(type, sectionReader, strings);
+		if (sectionReader.failed()) {
+			std::cerr << "Section " << (int)type << " of " << fileName << " is damaged" << std::endl;
+		}
+	}
+	source->loadingFinished();
+	return !reader.failed();
+}
+
+std::shared_ptr<lightforums::post> lightforums::binarySnapshot::loadThread(const std::string& fileName) {
+	std::shared_ptr<mappedFile> source = mappedFile::open(fileName);
+	std::shared_ptr<post> thread;
+	if (source) readFile(source, fileName, [&] (section type, binaryReader& reader, const std::vector<std::string>& strings) {
+		if (type != SECTION_POSTS) return;
+		thread = loadPost(reader, strings, source, nullptr);
+	});
+	if (!thread) std::cerr << "Could not read thread file " << fileName << ", the thread is left out until it can be" << std::endl;
+	return thread;
+}
+
+bool lightforums::binarySnapshot::load(const std::string& fileName) {
+	std::shared_ptr<mappedFile> source = mappedFile::open(fileName);
+	if (!source) return false;
+	Settings::get().setup();
+	bool postsLoaded = false;
+	uint64_t version = 0;
+	bool fine = readFile(source, fileName, [&] (section type, binaryReader& sectionReader, const std::vector<std::string>& strings) {
+		switch (type) {
+			case SECTION_SETTINGS: {
+				uint64_t count = sectionReader.getVarint();
+				for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) {
+					const std::string& field = getFromTable(strings, sectionReader.getVarint());
+					std::string value = sectionReader.getString();
+					if (field == "file_order") Settings::get().fileOrder.store(atoi(value.c_str()));
+					else Settings::get().setField(field, value);
+				}
+				break;
+			}
+			case SECTION_USERS: {
+				uint64_t count = sectionReader.getVarint();
+				for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) {
+					std::shared_ptr<user> made = std::make_shared<user>();
+					made->name_ = std::make_shared<std::string>(getFromTable(strings, sectionReader.getVarint()));
+					made->password_ = std::make_shared<std::string>(sectionReader.getString());
+					made->salt_ = std::make_shared<std::string>(sectionReader.getString());
+					made->rank_ = (rank)sectionReader.getByte();
+					if (made->rank_ >= rankSize) made->rank_ = USER;
+					if (sectionReader.getByte()) made->title_ = std::make_shared<std::string>(sectionReader.getString());
+					made->description_ = std::make_shared<std::string>(sectionReader.getString());
+					uint64_t ratingCount = sectionReader.getVarint();
+					for (uint64_t j = 0; j < ratingCount && !sectionReader.failed(); j++) {
+						if (version >= 5) {
+							uint64_t uid = sectionReader.getVarint();
+							rating rate = (rating)sectionReader.getByte();
+							if (rate < ratingSize) made->ratings_.insert(uid, rate);
+							continue;
+						}
+						std::string path; // Older versions kept ratings by paths, the posts are not loaded yet
+						uint64_t depth = sectionReader.getVarint();
+						for (uint64_t k = 0; k < depth && !sectionReader.failed(); k++) path += std::to_string(sectionReader.getVarint()) + "/";
+						rating rate = (rating)sectionReader.getByte();
+						if (rate < ratingSize) made->unresolvedRatings_.push_back(std::make_pair(postPath(path), rate));
+					}
+					if (!sectionReader.failed()) userList::get().users_.insert(*made->name_, made);
+				}
+				break;
+			}
+			case SECTION_POSTS: // Saved by the first version, without thread files
+				root::get().setRootPost(loadPost(sectionReader, strings, source, nullptr));
+				postsLoaded = true;
+				break;
+			case SECTION_THREADS: {
+				std::shared_ptr<post> rootPost = loadPost(sectionReader, strings, source, nullptr);
+				if (!rootPost) break;
+				uint64_t generation = sectionReader.getVarint();
+				if (generation > generation_) generation_ = generation;
+				uint64_t count = sectionReader.getVarint();
+				std::vector<std::pair<unsigned int, std::string>> threadFiles;
+				for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) {
+					unsigned int id = sectionReader.getVarint();
+					threadFiles.push_back(std::make_pair(id, sectionReader.getString()));
+				}
+
+				// Threads are read in parallel, the largest ones first so that no worker is left with a big one at the end
+				std::vector<off_t> sizes(threadFiles.size(), 0);
+				for (unsigned int i = 0; i < threadFiles.size(); i++) {
+					struct stat status;
+					if (!stat(threadFiles[i].second.c_str(), &status)) sizes[i] = status.st_size;
+				}
+				std::vector<unsigned int> order(threadFiles.size());
+				for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+				std::sort(order.begin(), order.end(), [&] (unsigned int a, unsigned int b) { return sizes[a] > sizes[b]; });
+				std::vector<std::shared_ptr<post>> threads(threadFiles.size());
+				std::vector<std::function<void ()>> tasks;
+				for (unsigned int i : order) tasks.push_back([i, &threads, &threadFiles] () {
+					threads[i] = loadThread(threadFiles[i].second);
+				});
+				runInParallel(tasks);
+
+				time_t lastActivity = rootPost->postedAt_;
+				for (unsigned int i = 0; i < threadFiles.size(); i++) {
+					previousFiles_.insert(threadFiles[i].second);
+					if (!threads[i]) {
+						unloaded_[threadFiles[i].first] = threadFiles[i].second;
+						continue;
+					}
+					if (!threads[i]->placeAt(rootPost, threadFiles[i].first)) {
+						std::cerr << "Thread " << threadFiles[i].first << " is in " << fileName << " twice, the second one is lost" << std::endl;
+						postIndex::get().remove(threads[i]);
+						auto kept = rootPost->children_.find(threadFiles[i].first);
+						if (kept != rootPost->children_.end()) postIndex::get().addSubtree(kept->second);
+						threads[i]->discard();
+						continue;
+					}
+					segments_[threadFiles[i].first] = threadFiles[i].second;
+					if (threads[i]->lastActivity_ > lastActivity) lastActivity = threads[i]->lastActivity_;
+				}
+				rootPost->lastActivity_.store(lastActivity);
+				root::get().setRootPost(rootPost);
+				postsLoaded = true;
+				break;
+			}
+			case SECTION_TRANSLATIONS: {
+				tr::getInstance().setByOriginal("", getCatalog(sectionReader));
+				break;
+			}
+			case SECTION_LOCALES: {
+				uint64_t count = sectionReader.getVarint();
+				for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) {
+					std::string locale = sectionReader.getString();
+					tr::getInstance().setByOriginal(locale, getCatalog(sectionReader));
+				}
+				break;
+			}
+			case SECTION_COOKIES: {
+				uint64_t count = sectionReader.getVarint();
+				for (uint64_t i = 0; i < count && !sectionReader.failed(); i++) {
+					std::string token = sectionReader.getString();
+					root::get().cookies_.insert(token, getFromTable(strings, sectionReader.getVarint()));
+				}
+				break;
+			}
+			default:
+				break; // Something from a newer version that can be done without
+		}
+	}, &version);
+	if (!postsLoaded || !fine) return false;
+	userList::get().setupUserList(nullptr); // Adds the default administrator if there are no users
+	return true;
+}
@@ -0,0 +1,67 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
+#include "defines.h"
+#include "epoch.h"
+
+#define SNAPSHOT_MAGIC "LFSNAP"
+#define SNAPSHOT_VERSION 5 // Since 3, files end with a checksum
+
+namespace lightforums {
+
+	class post;
+	class mappedFile;
+	class binaryWriter;
+	class binaryReader;
+
+	class binarySnapshot {
+		// Compact alternative to the XML save. The file starts with a magic string and a version, followed by
+		// sections of [type][varint length][contents], sections of unknown types are skipped. Strings that tend
+		// to repeat (names, settings keys, pins) are stored once in a string table and referred to by varint ids.
+		// The file is mapped when loaded, titles and texts of posts are not copied out of it.
+		// Every top-level thread is kept in its own segment file, named after the thread and the save that wrote it,
+		// and the main file only refers to them. A save rewrites only the threads that changed since the last one.
+	public:
+		enum section : unsigned char {
+			SECTION_END,
+			SECTION_STRINGS,
+			SECTION_SETTINGS,
+			SECTION_USERS,
+			SECTION_POSTS,
+			SECTION_TRANSLATIONS,
+			SECTION_COOKIES,
+			SECTION_THREADS,
+			SECTION_LOCALES, // Translations other than the default ones, which are in SECTION_TRANSLATIONS
+			sectionSize
+		};
+
+		static bool recognise(const std::string& fileName);
+		static bool save(const std::string& fileName);
+		static bool load(const std::string& fileName);
+
+	private:
+		class stringTable;
+		static void savePost(binaryWriter& writer, stringTable& strings, const epochs::snapshot& view, std::shared_ptr<post> saved, bool withChildren = true);
+		static bool saveThread(const std::string& fileName, const epochs::snapshot& view, std::shared_ptr<post> thread);
+		static bool writeFile(const std::string& fileName, stringTable& strings, binaryWriter& sections, bool syncDirectory = true);
+		static std::shared_ptr<post> loadPost(binaryReader& reader, const std::vector<std::string>& strings, std::shared_ptr<mappedFile> source, std::shared_ptr<post> parent);
+		static std::shared_ptr<post> loadThread(const std::string& fileName);
+		static bool readFile(std::shared_ptr<mappedFile> source, const std::string& fileName,
+							 std::function<void(section, binaryReader&, const std::vector<std::string>&)> onSection, uint64_t* versionRead = nullptr);
+
+		static std::unordered_map<unsigned int, std::string> segments_; // Thread id to its current file
+		static std::unordered_map<unsigned int, std::string> unloaded_; // Threads whose files couldn't be read, listed by every save
+		static std::unordered_set<std::string> previousFiles_; // Used by the previous save, which is kept as .old
+		static std::unordered_set<std::string> olderFiles_;
+		static uint64_t generation_;
+	};
+
+}
+
+#endif // SNAPSHOT_H
@@ -4,6 +4,12 @@
 #include <Wt/WInPlaceEdit>
 #include <Wt/WPushButton>
 #include "rapidxml.hpp"
+#include "xmlwriter.h"
+#include "mappedfile.h"
+#include <iostream>
+#if defined(__linux__) || defined(__APPLE__)
+#include <dirent.h>
+#endif
 
 #pragma GCC diagnostic ignored "-Wwrite-strings"
 
@@ -11,6 +17,8 @@ lightforums::tr::tr()
 {
 	original_[SET_GUEST_POSTING] = "Allow guests to post";
 	original_[SET_VIEW_DEPTH] = "Default view depth";
+	original_[SET_PAGE_SIZE] = "Replies shown at once (0 to show all)";
+	original_[SET_SINGLE_WIDGET_POSTS] = "Show the text of each post as a single widget (spoilers can't be animated)";
 	original_[SET_CAN_EDIT_OWN] = "Minimal rank to edit one's own posts";
 	original_[SET_CAN_DELETE_OWN] = "Minimal rank to delete one's own posts";
 	original_[SET_CAN_EDIT_OTHER] = "Minimal rank to edit others' posts";
@@ -25,10 +33,15 @@ lightforums::tr::tr()
 	original_[SET_CAN_UPLOAD] = "Minimal rank to upload files:";
 	original_[SET_DOWNLOAD_PATH] = "Path to downloads";
 	original_[SET_UPLOAD_PATH] = "Where to save uploaded files";
+	original_[SET_DURABLE_POSTS] = "Confirm new posts only after they are safely on disk";
+	original_[SET_DURABLE_WINDOW] = "Time to gather new posts into one disk write (in microseconds)";
+	original_[SET_SAVE_FORMAT] = "Format of the regular saves";
 	original_[SHOW_POSTS] = "Posts: X";
 	original_[SHOW_GUEST] = "Guest";
 	original_[SHOW_REPLIES] = "Show X replies";
 	original_[HIDE_REPLIES] = "Hide X replies";
+	original_[OLDER_REPLIES] = "Older replies";
+	original_[NEWER_REPLIES] = "Newer replies";
 	original_[GO_TO_PARENT] = "See parent post";
 	original_[WRITE_AUTHOR_NAME] = "Write your name here";
 	original_[WRITE_POST_TITLE] = "Write the title of the post here";
@@ -38,6 +51,9 @@ lightforums::tr::tr()
 	original_[WRITE_A_REPLY] = "Write a reply";
 	original_[EDIT_POST] = "Edit post";
 	original_[CANCEL_EDITING] = "Cancel editing";
+	original_[PREVIEW] = "Preview";
+	original_[POST_NOT_DURABLE] = "Not saved safely";
+	original_[POST_NOT_DURABLE_EXPLANATION] = "Your post is shown, but it could not be written to the disk, it may be lost if the server stops before the next save";
 	original_[DELETE_POST] = "Delete post";
 	original_[DO_DELETE_POST] = "Are you sure to delete the post?";
 	original_[GUEST_NAME] = "X (guest)";
@@ -120,53 +136,162 @@ lightforums::tr::tr()
 	original_[PIN] = "Pin:";
 	original_[WRITE_PIN_HERE] = "Write pin order here";
 	original_[PINNED_AFFIX] = "(Pinned) X";
+	original_[SAVE_FORMAT_XML] = "XML (readable, slower)";
+	original_[SAVE_FORMAT_BINARY] = "Binary (compact, faster)";
+
+	for (int i = 0; i < (int)translatableMax; i++) byOriginal_[original_[i]] = (translatable)i;
+	std::lock_guard<std::mutex> lock(editLock_);
+	default_ = catalogFor("");
+}
+
+thread_local const lightforums::tr::catalog* lightforums::tr::sessionCatalog_ = nullptr;
+
+lightforums::tr::localeScope::localeScope(const catalog* used) :
+	previous_(sessionCatalog_)
+{
+	sessionCatalog_ = used;
+}
+
+lightforums::tr::localeScope::~localeScope() {
+	sessionCatalog_ = previous_;
+}
+
+lightforums::tr::catalog* lightforums::tr::catalogFor(const std::string& locale) {
+	for (unsigned int i = 0; i < catalogs_.size(); i++)
+		if (catalogs_[i]->locale_ == locale) return catalogs_[i].get();
+	catalog* made = new catalog(locale);
+	table* first = new table;
+	for (int i = 0; i < (int)translatableMax; i++) {
+		first->shown[i] = original_[i];
+		first->translated[i] = false;
+	}
+	publish(made, first);
+	catalogs_.emplace_back(made);
+	return made;
+}
+
+void lightforums::tr::publish(const catalog* into, table* changed) {
+	into->published_.emplace_back(changed);
+	into->table_.store(changed, std::memory_order_release);
+}
+
+const lightforums::tr::catalog* lightforums::tr::findLocale(const std::string& locale) {
+	// An exact match is preferred, then one of the same language
+	std::lock_guard<std::mutex> lock(editLock_);
+	std::string language = locale.substr(0, locale.find_first_of("-_"));
+	const catalog* sameLanguage = nullptr;
+	for (unsigned int i = 0; i < catalogs_.size(); i++) {
+		const std::string& name = catalogs_[i]->locale_;
+		if (name.empty()) continue;
+		if (name == locale) return catalogs_[i].get();
+		if (!sameLanguage && name.substr(0, name.find_first_of("-_")) == language) sameLanguage = catalogs_[i].get();
+	}
+	return sameLanguage ? sameLanguage : default_;
 }
 
-void  lightforums::tr::init(rapidxml::xml_node<char>* source) {
+void lightforums::tr::init(rapidxml::xml_node<char>* source) {
+	rapidxml::xml_attribute<>* locale = source->first_attribute("locale");
+	loadSection(source, locale ? locale->value() : "");
+}
+
+void lightforums::tr::loadFiles(const std::string& directory) {
+#if defined(__linux__) || defined(__APPLE__)
+	DIR* listed = opendir(directory.c_str());
+	if (!listed) return;
+	std::vector<std::string> names;
+	for (dirent* entry = readdir(listed); entry; entry = readdir(listed)) {
+		std::string name = entry->d_name;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".xml") == 0) names.push_back(name);
+	}
+	closedir(listed);
+	for (unsigned int i = 0; i < names.size(); i++) {
+		std::string fileName = directory + "/" + names[i];
+		std::shared_ptr<mappedFile> file = mappedFile::open(fileName);
+		if (!file) continue;
+		std::vector<char> source(file->data(), file->data() + file->size()); // Parsing changes it
+		source.push_back(0);
+		rapidxml::xml_document<> document;
+		try {
+			document.parse<0>(source.data());
+		} catch (rapidxml::parse_error& error) {
+			std::cerr << "Could not parse " << fileName << ": " << error.what() << std::endl;
+			continue;
+		}
+		rapidxml::xml_node<>* section = document.first_node("translation");
+		if (!section) continue;
+		loadSection(section, names[i].substr(0, names[i].size() - 4));
+		std::cerr << "Loaded locale " << names[i].substr(0, names[i].size() - 4) << std::endl;
+	}
+#endif
+}
+
+void lightforums::tr::loadSection(rapidxml::xml_node<char>* source, const std::string& locale) {
+	std::vector<std::pair<std::string, std::string>> changes;
 	for (rapidxml::xml_node<>* node = source->first_node("tr"); node; node = node->next_sibling("tr")) {
 		const char* key = node->first_attribute("orig") ? node->first_attribute("orig")->value() : nullptr;
 		const char* value = node->first_attribute("new") ? node->first_attribute("new")->value() : nullptr;
 		if (!key || !value) continue;
-		for (int i = 0; i < (int)translatableMax; i++) {
-			if (!strcmp(original_[i], key)) {
-				translations_[i] = std::make_shared<std::string>(value);
-				break;
-			}
-		}
+		changes.push_back(std::make_pair(key, value));
 	}
+	setByOriginal(locale, changes);
 }
 
-rapidxml::xml_node<char>*  lightforums::tr::save(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings) {
-	rapidxml::xml_node<>* made = doc->allocate_node(rapidxml::node_element, "translation");
-	for (int i = 0; i < (int)translatableMax; i++) if (translations_[i]) {
-		std::shared_ptr<std::string> contents  = translations_[i];
-		strings.push_back(contents);
-		rapidxml::xml_node<>* node = doc->allocate_node(rapidxml::node_element, "tr");
-		node->append_attribute(doc->allocate_attribute("orig", original_[i]));
-		node->append_attribute(doc->allocate_attribute("new", contents->c_str()));
-		made->append_node(node);
+void lightforums::tr::setByOriginal(const std::string& locale, const std::vector<std::pair<std::string, std::string>>& changes) {
+	std::lock_guard<std::mutex> lock(editLock_);
+	catalog* into = catalogFor(locale); // Made even if empty, so it can be chosen and edited
+	if (changes.empty()) return;
+	table* changed = new table(*into->table_.load());
+	for (unsigned int i = 0; i < changes.size(); i++) {
+		auto found = byOriginal_.find(changes[i].first);
+		if (found == byOriginal_.end()) continue; // No longer used
+		changed->shown[found->second] = changes[i].second;
+		changed->translated[found->second] = true;
+	}
+	publish(into, changed);
+}
+
+void lightforums::tr::change(const catalog* edited, translatable what, const std::string* value) {
+	std::lock_guard<std::mutex> lock(editLock_);
+	table* changed = new table(*edited->table_.load());
+	changed->shown[what] = value ? *value : original_[what];
+	changed->translated[what] = (bool)value;
+	publish(edited, changed);
+}
+
+void lightforums::tr::save(xmlWriter& out) {
+	std::lock_guard<std::mutex> lock(editLock_);
+	for (unsigned int i = 0; i < catalogs_.size(); i++) {
+		out.startElement("translation");
+		if (!catalogs_[i]->locale_.empty()) out.attribute("locale", catalogs_[i]->locale_);
+		const table* current = catalogs_[i]->table_.load(std::memory_order_acquire);
+		for (int j = 0; j < (int)translatableMax; j++) {
+			if (!current->translated[j]) continue;
+			out.startElement("tr");
+			out.attribute("orig", original_[j]);
+			out.attribute("new", current->shown[j]);
+			out.endElement();
+		}
+		out.endElement();
 	}
-	return made;
 }
 
-Wt::WContainerWidget* lightforums::tr::edit(const std::string& viewer) {
+Wt::WContainerWidget* lightforums::tr::edit(const std::string& viewer, const catalog* edited) {
 	Wt::WContainerWidget* result = new Wt::WContainerWidget();
 	Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(result);
 
+	const table* current = edited->table_.load(std::memory_order_acquire);
 	for (int i = 0; i < translatableMax; i++) {
 		Wt::WInPlaceEdit* editor = new Wt::WInPlaceEdit(result);
 		layout->addWidget(editor);
 		editor->setPlaceholderText(Wt::WString(original_[i]));
-		if (translations_[i]) editor->setText(Wt::WString(*translations_[i]));
+		if (current->translated[i]) editor->setText(Wt::WString(current->shown[i]));
 		else editor->setText(Wt::WString(""));
-		editor->saveButton()->setText(Wt::WString(*tr::get(tr::SAVE_CHANGES)));
+		editor->saveButton()->setText(Wt::WString(tr::get(tr::SAVE_CHANGES)));
 		editor->saveButton()->clicked().connect(std::bind([=] () {
-			std::shared_ptr<std::string> obtainedText = std::make_shared<std::string>(editor->text().toUTF8());
-			if (obtainedText->empty())
-				obtainedText = nullptr;
-			std::atomic_store(&translations_[i], obtainedText);
+			std::string obtainedText = editor->text().toUTF8();
+			change(edited, (translatable)i, obtainedText.empty() ? nullptr : &obtainedText);
 		}));
-		editor->cancelButton()->setText(Wt::WString(*tr::get(tr::DISCARD_CHANGES)));
+		editor->cancelButton()->setText(Wt::WString(tr::get(tr::DISCARD_CHANGES)));
 		editor->setToolTip(Wt::WString(original_[i]));
 	}
 
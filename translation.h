@@ -4,6 +4,9 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 #include "defines.h"
 
 namespace lightforums {
@@ -12,6 +15,8 @@ namespace lightforums {
 		enum translatable : unsigned int {
 			SET_GUEST_POSTING,
 			SET_VIEW_DEPTH,
+			SET_PAGE_SIZE,
+			SET_SINGLE_WIDGET_POSTS,
 			SET_CAN_EDIT_OWN,
 			SET_CAN_DELETE_OWN,
 			SET_CAN_EDIT_OTHER,
@@ -26,10 +31,15 @@ namespace lightforums {
 			SET_CAN_UPLOAD,
 			SET_DOWNLOAD_PATH,
 			SET_UPLOAD_PATH,
+			SET_DURABLE_POSTS,
+			SET_DURABLE_WINDOW,
+			SET_SAVE_FORMAT,
 			SHOW_POSTS,
 			SHOW_GUEST,
 			SHOW_REPLIES,
 			HIDE_REPLIES,
+			OLDER_REPLIES,
+			NEWER_REPLIES,
 			GO_TO_PARENT,
 			WRITE_AUTHOR_NAME,
 			WRITE_POST_TITLE,
@@ -41,6 +51,9 @@ namespace lightforums {
 			WRITE_FIRST_REPLY,
 			EDIT_POST,
 			CANCEL_EDITING,
+			PREVIEW,
+			POST_NOT_DURABLE,
+			POST_NOT_DURABLE_EXPLANATION,
 			DELETE_POST,
 			DO_DELETE_POST,
 			USER_NAME,
@@ -121,18 +134,35 @@ namespace lightforums {
 			PIN,
 			WRITE_PIN_HERE,
 			PINNED_AFFIX,
+			SAVE_FORMAT_XML,
+			SAVE_FORMAT_BINARY,
 			translatableMax,
 		};
 
-		static std::shared_ptr<const std::string> get(translatable what) {
-			const std::shared_ptr<const std::string>& translated = getInstance().translations_[what];
-			if (translated) return translated;
-			return std::make_shared<std::string>(getInstance().original_[what]);
+		class catalog;
+
+		// The reference stays valid until exit, even if the translation is edited meanwhile
+		static const std::string& get(translatable what) {
+			const catalog* used = sessionCatalog_ ? sessionCatalog_ : getInstance().default_;
+			return used->table_.load(std::memory_order_acquire)->shown[what];
 		}
 
-		void init(rapidxml::xml_node<char>* source);
-		rapidxml::xml_node<char>* save(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings);
-		Wt::WContainerWidget* edit(const std::string& viewer);
+		class localeScope {
+			// While it exists, get() in this thread uses the given catalog, sessions set it around their events
+			const catalog* previous_;
+		public:
+			localeScope(const catalog* used);
+			~localeScope();
+			localeScope(const localeScope&) = delete;
+			void operator=(const localeScope&) = delete;
+		};
+
+		const catalog* findLocale(const std::string& locale); // Like "cs" or "cs-CZ", the default one if there's none for it
+		void init(rapidxml::xml_node<char>* source); // A <translation> section, its locale attribute says which catalog it fills
+		void loadFiles(const std::string& directory); // Every locale.xml in it with a <translation> section
+		void setByOriginal(const std::string& locale, const std::vector<std::pair<std::string, std::string>>& changes); // Original and translated
+		void save(xmlWriter& out);
+		Wt::WContainerWidget* edit(const std::string& viewer, const catalog* edited);
 
 		static inline tr& getInstance() {
 			static tr holder;
@@ -143,8 +173,40 @@ namespace lightforums {
 
 		tr();
 
-		std::shared_ptr<std::string> translations_[translatableMax];
+		struct table {
+			// Never changed once published, edits publish a changed copy, so reading needs no locking
+			std::string shown[translatableMax]; // The translation, or the original if there's none
+			bool translated[translatableMax];
+		};
+
+	public:
+		class catalog {
+			// Strings of one locale, the default one has an empty name
+			std::string locale_;
+			// Changing them publishes new contents, to anyone holding the catalog it's still the same one
+			mutable std::atomic<const table*> table_;
+			mutable std::vector<std::unique_ptr<const table>> published_; // With the old ones, readers may still use them, edits are rare
+			catalog(const std::string& locale) : locale_(locale) {}
+			friend class tr;
+			friend class binarySnapshot;
+		public:
+			const std::string& locale() const { return locale_; }
+		};
+
+	private:
+		catalog* catalogFor(const std::string& locale); // Made if it doesn't exist, call with editLock_ held
+		void loadSection(rapidxml::xml_node<char>* source, const std::string& locale);
+		void publish(const catalog* into, table* changed); // Call with editLock_ held
+		void change(const catalog* edited, translatable what, const std::string* value); // Removes the translation if null
+
+		std::vector<std::unique_ptr<catalog>> catalogs_; // Only added to, with editLock_ held
+		catalog* default_;
+		std::unordered_map<std::string, translatable> byOriginal_;
+		std::mutex editLock_;
 		char* original_[translatableMax];
+		static thread_local const catalog* sessionCatalog_;
+
+		friend class binarySnapshot;
 
 		tr(const tr&) = delete;
 		void operator=(const tr&) = delete;
@@ -15,9 +15,12 @@
 #include <Wt/Auth/HashFunction>
 #include <atomic>
 #include "rapidxml.hpp"
+#include "xmlwriter.h"
 #include "translation.h"
 #include "userlist.h"
 #include "settings.h"
+#include "journal.h"
+#include "postindex.h"
 
 lightforums::user::user() :
 	posts_(0)
@@ -43,12 +46,17 @@ lightforums::user::user(rapidxml::xml_node<>* from) :
 	description_ = std::make_shared<std::string>(descr ? descr->value() : "");
 	rank_ = (rank)atoi(getAttribute(from, "rank", "0"));
 
-	rapidxml::xml_node<>* ratingNode = from->first_node("ratings");
+	rapidxml::xml_node<>* ratingNode = from->first_node("rated");
 	if (ratingNode) for (ratingNode = ratingNode->first_node(); ratingNode; ratingNode = ratingNode->next_sibling()) {
 		rating rate = (rating)atoi(ratingNode->name());
-		if (rate > ratingSize) continue;
-		postPath path(ratingNode->value());
-		ratings_.insert(std::make_pair(path, rate));
+		if (rate >= ratingSize) continue;
+		ratings_.insert(strtoull(ratingNode->value(), nullptr, 10), rate);
+	}
+	ratingNode = from->first_node("ratings"); // Older saves, the posts are not loaded yet
+	if (ratingNode) for (ratingNode = ratingNode->first_node(); ratingNode; ratingNode = ratingNode->next_sibling()) {
+		rating rate = (rating)atoi(ratingNode->name());
+		if (rate >= ratingSize) continue;
+		unresolvedRatings_.push_back(std::make_pair(postPath(ratingNode->value()), rate));
 	}
 }
 
@@ -56,35 +64,24 @@ lightforums::user::~user() {
 
 }
 
-rapidxml::xml_node<char>* lightforums::user::getNode(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings) {
-	auto saveString = [&] (const char* key, std::shared_ptr<std::string> saved) -> rapidxml::xml_attribute<>* {
-		strings.push_back(saved);
-		return doc->allocate_attribute(key, saved->c_str());
-	};
-	auto saveNumber = [&] (const char* key, auto saved) -> rapidxml::xml_attribute<>* {
-		std::shared_ptr<std::string> made = std::make_shared<std::string>(std::to_string(saved));
-		strings.push_back(made);
-		return doc->allocate_attribute(key, made->c_str());
-	};
-	rapidxml::xml_node<>* made = doc->allocate_node(rapidxml::node_element, "user");
-	if (title_) made->append_attribute(saveString("title", title_));
-	made->append_attribute(saveString("name", name_));
-	made->append_attribute(saveString("password", password_));
-	made->append_attribute(saveString("salt", salt_));
-	if (description_) {
-		strings.push_back(description_);
-		made->append_node(doc->allocate_node(rapidxml::node_element, "description", description_->c_str()));
+void lightforums::user::save(xmlWriter& out, const epochs::snapshot& view) {
+	out.startElement("user");
+	std::shared_ptr<std::string> title = std::atomic_load(&title_);
+	if (title) out.attribute("title", *title);
+	out.attribute("name", *std::atomic_load(&name_));
+	out.attribute("password", *std::atomic_load(&password_));
+	out.attribute("salt", *std::atomic_load(&salt_));
+	out.numberAttribute("rank", (int)rank_);
+	std::shared_ptr<std::string> description = std::atomic_load(&description_);
+	if (description) out.element("description", *description);
+	out.startElement("rated");
+	std::vector<std::pair<uint64_t, rating>> ratings = ratingsAt(view);
+	for (unsigned int i = 0; i < ratings.size(); i++) {
+		std::string rate = std::to_string(ratings[i].second);
+		out.element(rate.c_str(), std::to_string(ratings[i].first));
 	}
-	made->append_attribute(saveNumber("rank", (int)rank_));
-	rapidxml::xml_node<>* ratings = doc->allocate_node(rapidxml::node_element, "ratings");
-	for (auto it = ratings_.begin(); it != ratings_.end(); it++) {
-		std::shared_ptr<std::string> rate = std::make_shared<std::string>(std::to_string(it->second));
-		std::shared_ptr<std::string> rated = std::make_shared<std::string>(it->first.getString());
-		strings.push_back(rate); strings.push_back(rated);
-		ratings->append_node(doc->allocate_node(rapidxml::node_element, rate->c_str(), rated->c_str()));
-	}
-	made->append_node(ratings);
-	return made;
+	out.endElement();
+	out.endElement();
 }
 
 std::string lightforums::user::getTitle() const {
@@ -117,8 +114,8 @@ Wt::WContainerWidget* lightforums::user::makeOverview() const {
 Wt::WContainerWidget* lightforums::user::makeGuestOverview(const std::string& name) {
 	Wt::WContainerWidget* result = new Wt::WContainerWidget();
 	Wt::WText* nameWidget = new Wt::WText(Wt::WString(name), result);
-	std::shared_ptr<const std::string> translated = tr::get(tr::SHOW_GUEST);
-	Wt::WText* guestWidget = new Wt::WText(Wt::WString(*translated), result);
+	const std::string& translated = tr::get(tr::SHOW_GUEST);
+	Wt::WText* guestWidget = new Wt::WText(Wt::WString(translated), result);
 	Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(result);
 	layout->addSpacing(Wt::WLength::Auto);
 	layout->addWidget(nameWidget);
@@ -138,69 +135,69 @@ Wt::WContainerWidget* lightforums::user::show(const std::string& viewer) {
 	Wt::WContainerWidget* gridContainer = new Wt::WContainerWidget(groupBox);
 	outerBox->addWidget(gridContainer);
 	Wt::WGridLayout* grid = new Wt::WGridLayout(gridContainer);
-	grid->addWidget(new Wt::WText(Wt::WString(*tr::get(tr::USER_NAME)), gridContainer), 0, 0);
+	grid->addWidget(new Wt::WText(Wt::WString(tr::get(tr::USER_NAME)), gridContainer), 0, 0);
 
 	if (viewing && viewing->rank_ != ADMIN)
 		grid->addWidget(new Wt::WText(Wt::WString(*std::atomic_load(&name_)), gridContainer), 0, 1);
 	else {
 		Wt::WInPlaceEdit* nameEditor = new Wt::WInPlaceEdit(*std::atomic_load(&name_), gridContainer);
-		nameEditor->setPlaceholderText(Wt::WString(*tr::get(tr::DONT_KEEP_THIS_EMPTY)));
-		nameEditor->saveButton()->setText(Wt::WString(*tr::get(tr::SAVE_CHANGES)));
+		nameEditor->setPlaceholderText(Wt::WString(tr::get(tr::DONT_KEEP_THIS_EMPTY)));
+		nameEditor->saveButton()->setText(Wt::WString(tr::get(tr::SAVE_CHANGES)));
 		nameEditor->saveButton()->clicked().connect(std::bind([=] () {
 			const std::string& username = nameEditor->text().toUTF8();
 			if (validateUsername(username)) {
 				if (!userList::get().getUser(username)) {
 					userList::get().renameUser(userList::get().getUser(*self->name_), username);
 				} else {
-					 messageBox(*tr::get(tr::LOGIN_ERROR), *tr::get(tr::USERNAME_UNAVAILABLE));
+					 messageBox(tr::get(tr::LOGIN_ERROR), tr::get(tr::USERNAME_UNAVAILABLE));
 				}
 			}
 		}));
-		nameEditor->cancelButton()->setText(Wt::WString(*tr::get(tr::DISCARD_CHANGES)));
-		nameEditor->setToolTip(Wt::WString(*tr::get(tr::CLICK_TO_EDIT)));
+		nameEditor->cancelButton()->setText(Wt::WString(tr::get(tr::DISCARD_CHANGES)));
+		nameEditor->setToolTip(Wt::WString(tr::get(tr::CLICK_TO_EDIT)));
 		grid->addWidget(nameEditor, 0, 1);
 	}
 
-	grid->addWidget(new Wt::WText(Wt::WString(*tr::get(tr::USER_TITLE)), gridContainer), 1, 0);
+	grid->addWidget(new Wt::WText(Wt::WString(tr::get(tr::USER_TITLE)), gridContainer), 1, 0);
 	if (viewing && viewing->rank_ == ADMIN) {
-		Wt::WInPlaceEdit* rankEdit = makeEditableText(&title_, gridContainer);
-		rankEdit->setToolTip(Wt::WString(*tr::get(tr::CLICK_TO_EDIT) + " " + *tr::get(tr::BLANK_FOR_DEFAULT)));
+		Wt::WInPlaceEdit* rankEdit = makeEditableText(&title_, gridContainer, [=] () { journal::get().userChanged(self); });
+		rankEdit->setToolTip(Wt::WString(tr::get(tr::CLICK_TO_EDIT) + " " + tr::get(tr::BLANK_FOR_DEFAULT)));
 		grid->addWidget(rankEdit, 1, 1);
 	} else
 		grid->addWidget(new Wt::WText(Wt::WString(getTitle()), gridContainer), 1, 1);
-	grid->addWidget(new Wt::WText(Wt::WString(*tr::get(tr::USER_POSTS)), gridContainer), 2, 0);
+	grid->addWidget(new Wt::WText(Wt::WString(tr::get(tr::USER_POSTS)), gridContainer), 2, 0);
 	grid->addWidget(new Wt::WText(Wt::WString(std::to_string(posts_)), gridContainer), 2, 1);
-	grid->addWidget(new Wt::WText(Wt::WString(*tr::get(tr::USER_RANK)), gridContainer), 3, 0);
+	grid->addWidget(new Wt::WText(Wt::WString(tr::get(tr::USER_RANK)), gridContainer), 3, 0);
 	if (viewing && viewing->rank_ == ADMIN)
-		grid->addWidget(makeEnumEditor((unsigned char*)&rank_, rankSize, tr::RANK_USER, gridContainer), 3, 1);
+		grid->addWidget(makeEnumEditor((unsigned char*)&rank_, rankSize, tr::RANK_USER, gridContainer, [=] () { journal::get().userChanged(self); }), 3, 1);
 	else
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get((tr::translatable)(tr::RANK_USER + rank_))), gridContainer), 3, 1);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get((tr::translatable)(tr::RANK_USER + rank_))), gridContainer), 3, 1);
 	if (viewing && (viewing->rank_ == ADMIN || viewing.get() == this)) {
-		grid->addWidget(new Wt::WText(Wt::WString(*tr::get(tr::CHANGE_PASSWORD_LINE)), gridContainer), 4, 0);
-		Wt::WPushButton* changePwButton = new Wt::WPushButton(*tr::get(tr::CHANGE_PASSWORD), gridContainer);
+		grid->addWidget(new Wt::WText(Wt::WString(tr::get(tr::CHANGE_PASSWORD_LINE)), gridContainer), 4, 0);
+		Wt::WPushButton* changePwButton = new Wt::WPushButton(tr::get(tr::CHANGE_PASSWORD), gridContainer);
 		grid->addWidget(changePwButton, 4, 1);
 
 		changePwButton->clicked().connect(std::bind([=] () {
-			Wt::WDialog* dialog = new Wt::WDialog(*lightforums::tr::get(lightforums::tr::CHANGE_PASSWORD));
+			Wt::WDialog* dialog = new Wt::WDialog(lightforums::tr::get(lightforums::tr::CHANGE_PASSWORD));
 			dialog->setModal(false);
 			Wt::WVBoxLayout* layout = new Wt::WVBoxLayout(dialog->contents());
 
 			Wt::WLineEdit* curPasswordEdit = new Wt::WLineEdit(dialog->contents());
 			curPasswordEdit->setEchoMode(Wt::WLineEdit::Password);
-			curPasswordEdit->setPlaceholderText(Wt::WString(*lightforums::tr::get(lightforums::tr::WRITE_YOUR_CURRENT_PASSWORD)));
+			curPasswordEdit->setPlaceholderText(Wt::WString(lightforums::tr::get(lightforums::tr::WRITE_YOUR_CURRENT_PASSWORD)));
 			layout->addWidget(curPasswordEdit);
 			Wt::WLineEdit* passwordEdit[2];
 			for (int i = 0; i <= 1; i++) {
 				passwordEdit[i] = new Wt::WLineEdit(dialog->contents());
 				passwordEdit[i]->setEchoMode(Wt::WLineEdit::Password);
-				passwordEdit[i]->setPlaceholderText(Wt::WString(*lightforums::tr::get((i == 0) ? lightforums::tr::WRITE_PASSWORD : lightforums::tr::REWRITE_PASSWORD)));
+				passwordEdit[i]->setPlaceholderText(Wt::WString(lightforums::tr::get((i == 0) ? lightforums::tr::WRITE_PASSWORD : lightforums::tr::REWRITE_PASSWORD)));
 				layout->addWidget(passwordEdit[i]);
 			}
 
 			Wt::WContainerWidget* buttonContainer = new Wt::WContainerWidget(dialog->contents());
 			layout->addWidget(buttonContainer);
 			Wt::WHBoxLayout* buttonLayout = new Wt::WHBoxLayout(buttonContainer);
-			Wt::WPushButton* changeButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::CHANGE_PASSWORD), buttonContainer);
+			Wt::WPushButton* changeButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::CHANGE_PASSWORD), buttonContainer);
 			changeButton->setDefault(true);
 			buttonLayout->addStretch(1);
 			buttonLayout->addWidget(changeButton);
@@ -208,17 +205,18 @@ Wt::WContainerWidget* lightforums::user::show(const std::string& viewer) {
 			changeButton->clicked().connect(std::bind([=] () {
 				static Wt::Auth::BCryptHashFunction cryptHasher(5);
 				if (!cryptHasher.verify(curPasswordEdit->text().toUTF8(), *viewing->salt_, *viewing->password_)) // Viewer, not necessarily this user
-					messageBox(*lightforums::tr::get(lightforums::tr::LOGIN_ERROR), *lightforums::tr::get(lightforums::tr::WRONG_PASSWORD));
-				else if (passwordEdit[0]->text() != passwordEdit[1]->text()) messageBox(*lightforums::tr::get(lightforums::tr::REGISTER_ERROR), *lightforums::tr::get(lightforums::tr::PASSWORDS_DONT_MATCH));
+					messageBox(lightforums::tr::get(lightforums::tr::LOGIN_ERROR), lightforums::tr::get(lightforums::tr::WRONG_PASSWORD));
+				else if (passwordEdit[0]->text() != passwordEdit[1]->text()) messageBox(lightforums::tr::get(lightforums::tr::REGISTER_ERROR), lightforums::tr::get(lightforums::tr::PASSWORDS_DONT_MATCH));
 				else {
 					std::string salt = lightforums::safeRandomString();
 					std::atomic_store(&self->password_, std::make_shared<std::string>(cryptHasher.compute(passwordEdit[0]->text().toUTF8(), salt)));
 					std::atomic_store(&self->salt_, std::make_shared<std::string>(salt));
+					journal::get().userChanged(self);
 					dialog->accept();
 				}
 			}));
 
-			Wt::WPushButton* dontChangeButton = new Wt::WPushButton(*lightforums::tr::get(lightforums::tr::DONT_CHANGE_PASSWORD), buttonContainer);
+			Wt::WPushButton* dontChangeButton = new Wt::WPushButton(lightforums::tr::get(lightforums::tr::DONT_CHANGE_PASSWORD), buttonContainer);
 			buttonLayout->addWidget(dontChangeButton);
 
 			dontChangeButton->clicked().connect(std::bind([=] () {
@@ -231,11 +229,11 @@ Wt::WContainerWidget* lightforums::user::show(const std::string& viewer) {
 	}
 	grid->setColumnStretch(1, 1);
 
-	Wt::WGroupBox* descrFrame = new Wt::WGroupBox(Wt::WString(*tr::get(tr::USER_DESCRIPTION)), groupBox);
+	Wt::WGroupBox* descrFrame = new Wt::WGroupBox(Wt::WString(tr::get(tr::USER_DESCRIPTION)), groupBox);
 	outerBox->addWidget(descrFrame);
 	Wt::WHBoxLayout* descrLayout = new Wt::WHBoxLayout(descrFrame);
 	if (viewing && (viewing->rank_ == ADMIN || viewing.get() == this)) {
-		Wt::WInPlaceEdit* descrEdit = makeEditableText(&description_, descrFrame);
+		Wt::WInPlaceEdit* descrEdit = makeEditableText(&description_, descrFrame, [=] () { journal::get().userChanged(self); });
 		descrLayout->addWidget(descrEdit, 1);
 		//descrEdit->lineEdit()->setMinimumSize(Wt::WLength(descrFrame->width().Centimeter, Wt::WLength::Centimeter), descrFrame->height()); // How to make it larger when editing? CSS?
 	} else {
@@ -250,23 +248,13 @@ Wt::WContainerWidget* lightforums::user::show(const std::string& viewer) {
 	return result;
 }
 
-void lightforums::user::digestPost(std::shared_ptr<post> digested) {
-	std::shared_ptr<user> author = userList::get().getUser(*digested->author_);
-	auto found = ratings_.find(digested);
-	if (found != ratings_.end()) {
-		digested->rating_[found->second]++;
-		if (author) {
-			author->rating_[found->second]++;
-			if (author.get() == this) {
-				posts_++;
-			}
-		}
-	}
-	if (author.get() == this) {
-		posts_++;
-	}
-	for (auto it = digested->children_.begin(); it != digested->children_.end(); it++) {
-		digestPost(it->second);
+void lightforums::user::digestRatings() {
+	for (auto it = ratings_.begin(); it != ratings_.end(); it++) {
+		std::shared_ptr<post> rated = postIndex::get().find(it->first);
+		if (!rated) continue; // Deleted since
+		rated->rating_[it->second]++;
+		std::shared_ptr<user> author = userList::get().getUser(*std::atomic_load(&rated->author_));
+		if (author) author->rating_[it->second]++;
 	}
 }
 
@@ -275,26 +263,35 @@ bool lightforums::user::validateUsername(const std::string& name, bool warn) {
 	for (unsigned int i = 0; i < name.size(); i++) {
 		if ((name[i] >= 'A' && name[i] <= 'Z') || (name[i] >= 'a' && name[i] <= 'z') || (name[i] >= '0' && name[i] <= '9') || name[i] == '_') continue;
 		fine = false;
-		if (warn) messageBox(*tr::get(tr::LOGIN_ERROR), *tr::get(tr::USERNAME_ILLEGAL_CHARACTER));
+		if (warn) messageBox(tr::get(tr::LOGIN_ERROR), tr::get(tr::USERNAME_ILLEGAL_CHARACTER));
 		break;
 	}
 	if (name.empty()) {
 		fine = false;
-		if (warn) messageBox(*tr::get(tr::LOGIN_ERROR), *tr::get(tr::USERNAME_CANT_BE_EMPTY));
+		if (warn) messageBox(tr::get(tr::LOGIN_ERROR), tr::get(tr::USERNAME_CANT_BE_EMPTY));
 	}
 	return fine;
 }
 
 void lightforums::user::ratePost(std::shared_ptr<post> rated, rating rate) {
-	postPath path(rated);
+	uint64_t id = rated->getUid();
 	std::shared_ptr<std::string> writer = rated->author_;
 	std::shared_ptr<user> author = writer ? userList::get().getUser(*writer) : nullptr;
-	auto found = ratings_.find(path);
+	auto found = ratings_.find(id);
+	epochs::writeScope change;
+	if (epochs::get().snapshotsActive()) {
+		std::shared_ptr<ratingChange> kept = std::make_shared<ratingChange>(id);
+		kept->existed = (found != ratings_.end());
+		kept->before = kept->existed ? found->second : ratingSize;
+		kept->at = change.epoch();
+		kept->older = std::atomic_load(&ratingHistory_);
+		while (!std::atomic_compare_exchange_weak(&ratingHistory_, &kept->older, kept));
+	} else if (std::atomic_load(&ratingHistory_)) std::atomic_store(&ratingHistory_, std::shared_ptr<ratingChange>());
 	if (rate < ratingSize) {
 		if (found == ratings_.end()) {
 			if (author) author->rating_[rate]++;
 			rated->rating_[rate]++;
-			ratings_.insert(path, rate);
+			ratings_.insert(id, rate);
 		}
 		else {
 			if (author) author->rating_[found->second]--;
@@ -308,6 +305,30 @@ void lightforums::user::ratePost(std::shared_ptr<post> rated, rating rate) {
 			if (author) author->rating_[found->second]--;
 			rated->rating_[found->second]--;
 		}
-		ratings_.erase(path);
+		ratings_.erase(id);
+	}
+	journal::get().postRated(*std::atomic_load(&name_), rated, rate);
+}
+
+std::vector<std::pair<uint64_t, lightforums::rating>> lightforums::user::ratingsAt(const epochs::snapshot& view) {
+	// The current ratings must be read first, a change is put into the history before it's made
+	std::unordered_map<uint64_t, rating> state;
+	for (auto it = ratings_.begin(); it != ratings_.end(); it++) state.insert(std::make_pair(it->first, it->second));
+	for (std::shared_ptr<ratingChange> it = std::atomic_load(&ratingHistory_); it; it = it->older) {
+		if (view.sees(it->at)) break;
+		if (it->existed) state[it->postId] = it->before;
+		else state.erase(it->postId);
+	}
+	std::vector<std::pair<uint64_t, rating>> result;
+	result.reserve(state.size());
+	for (auto it = state.begin(); it != state.end(); it++) result.push_back(*it);
+	return result;
+}
+
+void lightforums::user::resolveRatings(std::shared_ptr<post> from) {
+	for (unsigned int i = 0; i < unresolvedRatings_.size(); i++) {
+		std::shared_ptr<post> rated = from->find(unresolvedRatings_[i].first);
+		if (rated) ratings_.insert(rated->getUid(), unresolvedRatings_[i].second);
 	}
+	unresolvedRatings_.clear();
 }
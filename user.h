@@ -13,13 +13,23 @@
 
 namespace lightforums {
 
+	struct ratingChange {
+		// Undoes a change of a user's ratings for saves that started before it
+		uint64_t postId;
+		bool existed;
+		rating before;
+		uint64_t at; // Epoch
+		std::shared_ptr<ratingChange> older;
+		ratingChange(uint64_t changed) : postId(changed) {}
+	};
+
 	class user
 	{
 	public:
 		user();
 		user(rapidxml::xml_node<>* from);
 		~user();
-		rapidxml::xml_node<char>* getNode(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings);
+		void save(xmlWriter& out, const epochs::snapshot& view);
 
 		std::shared_ptr<std::string> name_;
 		std::shared_ptr<std::string> password_;
@@ -28,13 +38,15 @@ namespace lightforums {
 		rank rank_;
 		std::atomic_uint_fast32_t posts_;
 		std::atomic_int rating_[ratingSize];
-		atomic_unordered_map<postPath, rating> ratings_;
+		atomic_unordered_map<uint64_t, rating> ratings_; // By global ids of posts
 
 		Wt::WContainerWidget* makeOverview() const;
 		static Wt::WContainerWidget* makeGuestOverview(const std::string& name);
 		Wt::WContainerWidget* show(const std::string& viewer);
-		void digestPost(std::shared_ptr<post> digested);
+		void digestRatings(); // Adds the ratings given by this user to the posts and their authors
 		void ratePost(std::shared_ptr<post> rated, rating rate);
+		std::vector<std::pair<uint64_t, rating>> ratingsAt(const epochs::snapshot& view);
+		void resolveRatings(std::shared_ptr<post> from); // Call when all posts have their ids
 
 		static bool validateUsername(const std::string& name, bool warn = true);
 
@@ -43,8 +55,11 @@ namespace lightforums {
 
 	private:
 		std::shared_ptr<std::string> title_;
+		std::shared_ptr<ratingChange> ratingHistory_; // Newest first
+		std::vector<std::pair<postPath, rating>> unresolvedRatings_; // From saves that kept ratings by paths
 
 		friend class userProxy;
+		friend class binarySnapshot;
 	};
 
 }
@@ -1,6 +1,8 @@
 #include "userlist.h"
 #include <iostream>
 #include "rapidxml.hpp"
+#include "xmlwriter.h"
+#include "journal.h"
 
 lightforums::userList::userList()
 {
@@ -8,8 +10,7 @@ lightforums::userList::userList()
 
 void lightforums::userList::setupUserList(rapidxml::xml_node<>* from) {
 	if (from) for (rapidxml::xml_node<>* node = from->first_node("user"); node; node = node->next_sibling("user")) {
-		std::shared_ptr<user> made = std::make_shared<user>(node);
-		users_.insert(*std::atomic_load(&made->name_), made);
+		loadUser(node);
 	}
 	std::cerr << "Users size " << users_.size() << std::endl;
 	if (users_.size() == 0) {
@@ -24,34 +25,57 @@ void lightforums::userList::setupUserList(rapidxml::xml_node<>* from) {
 	}
 }
 
-rapidxml::xml_node<>* lightforums::userList::save(rapidxml::xml_document<>* doc, std::vector<std::shared_ptr<std::string>>& strings) {
-	rapidxml::xml_node<>* result = doc->allocate_node(rapidxml::node_element, "users");
+void lightforums::userList::loadUser(rapidxml::xml_node<>* from) {
+	std::shared_ptr<user> made = std::make_shared<user>(from);
+	users_.insert(*std::atomic_load(&made->name_), made);
+}
+
+void lightforums::userList::save(xmlWriter& out, const epochs::snapshot& view) {
+	out.startElement("users");
 	for (auto it = users_.begin(); it != users_.end(); it++) {
-		rapidxml::xml_node<>* node = it->second->getNode(doc, strings);
-		result->append_node(node);
+		it->second->save(out, view);
 	}
-	return result;
+	out.endElement();
 }
 
 void lightforums::userList::digestPost(std::shared_ptr<post> digested) {
+	// Every rating is looked up once, then the tree is walked once to count the posts of each author
+	for (auto it = users_.begin(); it != users_.end(); it++) {
+		it->second->digestRatings();
+	}
+	countPosts(digested);
+}
+
+void lightforums::userList::resolveRatings(std::shared_ptr<post> from) {
 	for (auto it = users_.begin(); it != users_.end(); it++) {
-		it->second->digestPost(digested);
+		it->second->resolveRatings(from);
+	}
+}
+
+void lightforums::userList::countPosts(std::shared_ptr<post> from) {
+	std::shared_ptr<user> author = getUser(*std::atomic_load(&from->author_));
+	if (author) author->posts_++;
+	for (auto it = from->children_.begin(); it != from->children_.end(); it++) {
+		countPosts(it->second);
 	}
 }
 
 bool lightforums::userList::renameUser(std::shared_ptr<user> who, const std::string& newName) {
-	const std::string& oldName = *who->name_;
+	std::shared_ptr<std::string> oldName = std::atomic_load(&who->name_);
 	auto found = users_.find(newName);
 	if (found != users_.end()) return false; // Exists
 	users_.insert(newName, who);
-	users_.erase(oldName);
+	users_.erase(*oldName);
 	std::shared_ptr<std::string> renamed = std::make_shared<std::string>(newName);
 	std::atomic_store(&who->name_, renamed);
+	journal::get().userRenamed(*oldName, newName);
 	return true;
 }
 
 bool lightforums::userList::addUser(std::shared_ptr<user> added) {
-	return users_.insert(*added->name_, added);
+	if (!users_.insert(*added->name_, added)) return false;
+	journal::get().userAdded(added);
+	return true;
 }
 
 //bool lightforums::userList::deleteUser(const std::string& name) {
@@ -21,8 +21,10 @@ namespace lightforums {
 		}
 
 		void setupUserList(rapidxml::xml_node<>* from);
-		rapidxml::xml_node<>* save(rapidxml::xml_document<char>* doc, std::vector<std::shared_ptr<std::string>>& strings);
+		void loadUser(rapidxml::xml_node<>* from);
+		void save(xmlWriter& out, const epochs::snapshot& view);
 		void digestPost(std::shared_ptr<post> digested);
+		void resolveRatings(std::shared_ptr<post> from);
 		bool renameUser(std::shared_ptr<user> who, const std::string& newName);
 		bool addUser(std::shared_ptr<user> added);
 
@@ -35,9 +37,12 @@ namespace lightforums {
 	private:
 
 		userList();
+		void countPosts(std::shared_ptr<post> from);
 
 		atomic_unordered_map<std::string, std::shared_ptr<user>> users_;
 
+		friend class binarySnapshot;
+
 		userList(const userList&) = delete;
 		void operator=(const userList&) = delete;
 	};
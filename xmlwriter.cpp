@@ -0,0 +1,132 @@
+#include "xmlwriter.h"
+
+#include <cstring>
+#include <cstdio>
+#include "escape.h"
+
+lightforums::xmlWriter::xmlWriter() :
+	startTagOpen_(false),
+	failed_(false)
+{
+	buffer_.reserve(bufferSize + 64);
+}
+
+lightforums::xmlWriter::~xmlWriter() {
+}
+
+bool lightforums::xmlWriter::open(const std::string& fileName) {
+	failed_ = !file_.open(fileName);
+	return !failed_;
+}
+
+bool lightforums::xmlWriter::finish() {
+	while (!open_.empty()) endElement();
+	flush();
+	if (failed_) {
+		file_.discard();
+		return false;
+	}
+	return file_.commit();
+}
+
+void lightforums::xmlWriter::flush() {
+	if (!failed_ && !buffer_.empty() && !file_.write(buffer_.c_str(), buffer_.size())) failed_ = true;
+	buffer_.clear();
+}
+
+void lightforums::xmlWriter::put(const char* data, size_t size) {
+	if (buffer_.size() + size > bufferSize) {
+		flush();
+		if (size > bufferSize) { // Large texts don't need to go through the buffer
+			buffer_.assign(data, size);
+			flush();
+			return;
+		}
+	}
+	buffer_.append(data, size);
+}
+
+void lightforums::xmlWriter::putEscaped(const char* data, size_t size) {
+	const char* end = data + size;
+	const char* plain = data; // Start of the part that needs no escaping
+	for (const char* at = data; at < end; at++) {
+		at += escaper::findSpecial(at, end - at, escaper::XML_SPECIAL);
+		if (at == end) break;
+		const char* entity;
+		switch (*at) {
+			case '<': entity = "&lt;"; break;
+			case '>': entity = "&gt;"; break;
+			case '&': entity = "&amp;"; break;
+			case '"': entity = "&quot;"; break;
+			case '\'': entity = "&apos;"; break;
+			default: continue;
+		}
+		put(plain, at - plain);
+		put(entity, strlen(entity));
+		plain = at + 1;
+	}
+	put(plain, end - plain);
+}
+
+void lightforums::xmlWriter::closeStartTag() {
+	if (!startTagOpen_) return;
+	put('>');
+	startTagOpen_ = false;
+}
+
+void lightforums::xmlWriter::declaration() {
+	static const char declared[] = "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+	put(declared, sizeof(declared) - 1);
+}
+
+void lightforums::xmlWriter::startElement(const char* name) {
+	if (!open_.empty()) {
+		openElement& parent = open_.back();
+		if (!parent.hasChildren) {
+			closeStartTag();
+			put('\n');
+			parent.hasChildren = true;
+		}
+	}
+	for (unsigned int i = 0; i < open_.size(); i++) put('\t');
+	put('<');
+	put(name, strlen(name));
+	open_.push_back(openElement{name, false, false});
+	startTagOpen_ = true;
+}
+
+void lightforums::xmlWriter::attribute(const char* name, const char* value, size_t size) {
+	put(' ');
+	put(name, strlen(name));
+	put("=\"", 2);
+	putEscaped(value, size);
+	put('"');
+}
+
+void lightforums::xmlWriter::numberAttribute(const char* name, long long int value) {
+	char written[24];
+	int size = snprintf(written, sizeof(written), "%lld", value);
+	attribute(name, written, size);
+}
+
+void lightforums::xmlWriter::text(const char* value, size_t size) {
+	if (open_.empty()) return;
+	closeStartTag();
+	putEscaped(value, size);
+	open_.back().hasText = true;
+}
+
+void lightforums::xmlWriter::endElement() {
+	if (open_.empty()) return;
+	openElement closed = open_.back();
+	open_.pop_back();
+	if (startTagOpen_) {
+		put("/>\n", 3);
+		startTagOpen_ = false;
+		return;
+	}
+	if (closed.hasChildren) for (unsigned int i = 0; i < open_.size(); i++) put('\t');
+	put("</", 2);
+	put(closed.name, strlen(closed.name));
+	put(">\n", 2);
+}
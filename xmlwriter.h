@@ -0,0 +1,64 @@
+#ifndef XMLWRITER_H
+#define XMLWRITER_H
+
+#include <string>
+#include <vector>
+#include "atomicfile.h"
+
+namespace lightforums {
+
+	class xmlWriter {
+		// Writes XML straight into a file through a buffer, without building a document in memory first.
+		// Elements are started, given attributes, then either text or child elements, and ended.
+		// The output is indented with tabs like rapidxml's printer, so both can be read back the same way.
+	public:
+		xmlWriter();
+		~xmlWriter(); // An unfinished file is thrown away
+
+		bool open(const std::string& fileName);
+		bool finish(); // Writes what's left and puts the file in place, false if anything failed on the way, then the old file stays
+
+		void declaration();
+		void startElement(const char* name);
+		void attribute(const char* name, const char* value, size_t size);
+		void attribute(const char* name, const std::string& value) { attribute(name, value.c_str(), value.size()); }
+		void numberAttribute(const char* name, long long int value);
+		void text(const char* value, size_t size);
+		void text(const std::string& value) { text(value.c_str(), value.size()); }
+		void endElement();
+		void element(const char* name, const std::string& value) {
+			startElement(name);
+			text(value);
+			endElement();
+		}
+
+	private:
+		struct openElement {
+			const char* name;
+			bool hasText;
+			bool hasChildren;
+		};
+
+		void put(char character) {
+			buffer_.push_back(character);
+			if (buffer_.size() >= bufferSize) flush();
+		}
+		void put(const char* data, size_t size);
+		void putEscaped(const char* data, size_t size);
+		void closeStartTag();
+		void flush();
+
+		static const size_t bufferSize = 1 << 16;
+		std::string buffer_;
+		std::vector<openElement> open_;
+		bool startTagOpen_;
+		atomicFile file_;
+		bool failed_;
+
+		xmlWriter(const xmlWriter&) = delete;
+		void operator=(const xmlWriter&) = delete;
+	};
+
+}
+
+#endif // XMLWRITER_H